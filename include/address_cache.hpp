@@ -0,0 +1,48 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __I3DS_ADDRESS_CACHE_HPP
+#define __I3DS_ADDRESS_CACHE_HPP
+
+#include <string>
+
+namespace i3ds
+{
+
+// Remembers the IP and MAC address a named camera was last found at, in
+// one file per camera in the given directory, so that it can be connected
+// to directly without discovery.
+class AddressCache
+{
+public:
+
+  // An empty directory disables the cache.
+  AddressCache(const std::string& directory, const std::string& camera_name);
+
+  bool enabled() const {return !path_.empty();}
+
+  // Returns false if no address is cached.
+  bool load(std::string& ip, std::string& mac) const;
+
+  // Replaces the cached address. Returns false if it could not be written.
+  bool store(const std::string& ip, const std::string& mac) const;
+
+  // Removes a stale address.
+  void clear() const;
+
+private:
+
+  std::string directory_;
+  std::string path_;
+};
+
+} // namespace i3ds
+
+#endif
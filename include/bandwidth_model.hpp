@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __I3DS_BANDWIDTH_MODEL_HPP
+#define __I3DS_BANDWIDTH_MODEL_HPP
+
+#include <cstdint>
+
+namespace i3ds
+{
+
+// Time a GigE Vision camera needs to put one frame on the link.
+//
+// Each frame is sent as a leader, data packets and a trailer. Every packet
+// carries IP, UDP and GVSP headers inside the configured packet size, plus
+// Ethernet framing, preamble and inter-frame gap on the wire, and is
+// followed by the inter-packet delay.
+struct BandwidthModel
+{
+  // IP, UDP and GVSP headers included in the packet size.
+  static const int64_t packet_headers = 36;
+
+  // Ethernet header, FCS, preamble and inter-frame gap.
+  static const int64_t wire_overhead = 38;
+
+  // Share of the link a stream may plan to use.
+  static constexpr double max_utilization = 0.9;
+
+  int64_t payload_size;       // Bytes per frame.
+  int64_t packet_size;        // GevSCPSPacketSize in bytes.
+  int64_t packet_delay;       // GevSCPD in timestamp ticks.
+  double tick_frequency;      // Timestamp ticks per second.
+  int64_t link_speed;         // Link speed in Mbit/s.
+
+  int64_t packets() const
+  {
+    const int64_t data = packet_size > packet_headers ? packet_size - packet_headers : 1;
+    return (payload_size + data - 1) / data + 2;
+  }
+
+  // Link time of a frame in microseconds, including packet delays.
+  double frameTime() const
+  {
+    const double bits = (payload_size + packets() * (packet_headers + wire_overhead)) * 8.0;
+    const double transmit = bits / (link_speed * max_utilization);
+    const double delays = packets() * packet_delay * 1e6 / tick_frequency;
+
+    return transmit + delays;
+  }
+
+  // Highest frame rate the link sustains, in Hz.
+  double maxFrameRate() const
+  {
+    return 1e6 / frameTime();
+  }
+
+  // Shortest sustainable frame period in microseconds.
+  int64_t minPeriod() const
+  {
+    return (int64_t) (frameTime() + 0.5);
+  }
+
+  // Link bandwidth used at the given period, in Mbit/s.
+  double bandwidth(int64_t period_us) const
+  {
+    return (payload_size + packets() * (packet_headers + wire_overhead)) * 8.0 / period_us;
+  }
+};
+
+} // namespace i3ds
+
+#endif
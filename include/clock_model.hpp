@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __I3DS_CLOCK_MODEL_HPP
+#define __I3DS_CLOCK_MODEL_HPP
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+namespace i3ds
+{
+
+// Maps device timestamp ticks to host time in microseconds.
+//
+// Host times may be on any clock, but should be on a monotonic one, since
+// a jump in host time is taken as drift.
+//
+// The model is a least squares line through the latest synchronization
+// points, each pairing a device timestamp with the host time it was taken
+// at. The slope follows the drift between the two oscillators, and the
+// residuals of the fit give the error estimate.
+class ClockModel
+{
+public:
+
+  explicit ClockModel(size_t window = 32);
+
+  // Forgets all points and sets the nominal tick frequency in Hz.
+  void reset(double tick_frequency);
+
+  // Adds a synchronization point, where uncertainty is the half width in
+  // microseconds of the host interval the device time was taken in.
+  void addPoint(uint64_t ticks, int64_t host_us, double uncertainty_us);
+
+  // Maps device ticks to host time. Returns false before the first point.
+  bool toHost(uint64_t ticks, int64_t& host_us, double& error_us) const;
+
+  // Device clock rate relative to the host in parts per million.
+  double drift() const;
+
+  // Estimated mapping error in microseconds.
+  double error() const;
+
+  size_t points() const;
+
+private:
+
+  struct Point
+  {
+    double device_us;
+    double host_us;
+    double uncertainty_us;
+  };
+
+  void fit();
+
+  const size_t window_;
+
+  mutable std::mutex mutex_;
+
+  double tick_frequency_;
+
+  // Points are kept relative to the first one, to keep the fit precise.
+  bool has_origin_;
+  uint64_t origin_ticks_;
+  int64_t origin_host_us_;
+
+  std::deque<Point> points_;
+
+  // host_us = offset_ + slope_ * device_us, relative to the origin.
+  double offset_;
+  double slope_;
+  double error_;
+};
+
+} // namespace i3ds
+
+#endif
@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef __I3DS_COMMAND_QUEUE_HPP
+#define __I3DS_COMMAND_QUEUE_HPP
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <condition_variable>
+
+namespace i3ds
+{
+
+// Runs device commands in order on a thread of its own, so that a slow
+// device does not hold up the thread queuing them.
+//
+// A command queued under a key replaces a command with the same key that
+// has not started yet. The replacement moves to the back of the queue, and
+// the callers of both get its result. Commands queued without a key are
+// never replaced.
+class CommandQueue
+{
+public:
+
+  typedef std::function<void()> Command;
+
+  struct Statistics
+  {
+    int64_t executed;
+    int64_t coalesced;
+    int64_t cancelled;
+    int64_t failed;
+    int64_t pending;
+
+    // Time from queuing to completion in microseconds.
+    double mean_latency;
+    int64_t max_latency;
+  };
+
+  CommandQueue();
+  ~CommandQueue();
+
+  // Runs the remaining commands and stops the thread.
+  void stop();
+
+  // Queues a command. The future holds its exception if it throws.
+  std::shared_future<void> submit(const std::string& key, Command command);
+
+  // Removes the command queued under the key if it has not started yet.
+  // Its future then holds an exception. Returns false if there is no such
+  // command, as when it is already running or done.
+  bool cancel(const std::string& key);
+
+  // Waits until all queued commands have run, or only the running one if
+  // paused.
+  void flush();
+
+  // Holds off queued commands, waiting for the running one to finish.
+  // Commands are still queued and coalesced while paused.
+  void pause();
+
+  // Runs the queued commands again.
+  void resume();
+
+  Statistics statistics() const;
+
+private:
+
+  struct Entry
+  {
+    std::string key;
+    Command command;
+    std::promise<void> promise;
+    std::shared_future<void> future;
+    std::chrono::steady_clock::time_point queued;
+  };
+
+  void run();
+
+  mutable std::mutex mutex_;
+  std::condition_variable work_cond_;
+  std::condition_variable idle_cond_;
+  std::deque<std::shared_ptr<Entry>> queue_;
+  bool busy_;
+  bool running_;
+  bool paused_;
+
+  Statistics stats_;
+  int64_t total_latency_;
+
+  std::thread thread_;
+};
+
+} // namespace i3ds
+
+#endif
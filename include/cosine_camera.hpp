@@ -14,7 +14,28 @@
 
 #include <i3ds/gige_camera_sensor.hpp>
 
+#include "frame_ring.hpp"
+#include "stream_statistics.hpp"
+#include "frame_log.hpp"
+#include "pixel_kernels.hpp"
+#include "clock_model.hpp"
+#include "resend_policy.hpp"
+#include "delay_tuner.hpp"
+#include "bandwidth_model.hpp"
+#include "link_coordinator.hpp"
+#include "address_cache.hpp"
+#include "stall_detector.hpp"
+#include "command_queue.hpp"
+
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <string>
+#include <map>
+#include <deque>
 
 #include <PvDevice.h>
 #include <PvPipeline.h>
@@ -26,14 +47,168 @@
 namespace i3ds
 {
 
-class CosineCamera : public GigECamera, protected PvDeviceEventSink
+class CosineCamera : public GigECamera, protected PvDeviceEventSink, protected PvGenEventSink
 {
 public:
 
-  CosineCamera(Context::Ptr context, NodeID id, GigECamera::Parameters param, int trigger_scale);
+  // Driver options not covered by the generic GigE camera parameters.
+  struct Options
+  {
+    // Number of frames that may wait between acquisition and publishing.
+    int ring_size;
+
+    // What to do with a frame when the publisher has fallen behind.
+    OverflowPolicy overflow;
+
+    // Pipeline buffer count, or zero to derive it from the memory budget.
+    int buffer_count;
+
+    // Memory the pipeline buffers may use in MiB.
+    int64_t buffer_budget;
+
+    // Interval between stream statistics samples in milliseconds.
+    int stats_period;
+
+    // Use a packed 12-bit pixel format on the link when available.
+    bool packed_pixels;
+
+    // Time in milliseconds a frame may be held back waiting for resent
+    // packets. Resend is switched on and off by the observed loss, zero
+    // disables it.
+    int resend_latency;
+
+    // Negotiate the largest packet size the path carries at Open(), and
+    // tune the inter-packet delay from measured loss while streaming.
+    // Otherwise the packet size and delay parameters are written only
+    // when given, and the device settings are kept when not.
+    bool auto_transport;
+
+    // Whether the packet size and delay parameters were given, rather
+    // than left at their defaults.
+    bool packet_size_given;
+    bool packet_delay_given;
+
+    // Name of the link shared with other camera nodes on this host. The
+    // nodes divide it between them by setting their inter-packet delays.
+    // Empty to not coordinate.
+    std::string link_group;
+
+    // Directory the camera address is cached in between runs, so that it
+    // can be connected to without discovery. Empty to always discover.
+    std::string address_cache;
+
+    // Keep the stream and pipeline open from Open() to Close(), so that
+    // Start() and Stop() only start and stop acquisition.
+    bool warm_stream;
+
+    // Time in milliseconds a parameter write is waited for before the
+    // server call fails as busy. A write not yet started is cancelled, one
+    // already running completes later.
+    int command_timeout;
+  };
+
+  CosineCamera(Context::Ptr context, NodeID id, GigECamera::Parameters param, int trigger_scale,
+               Options options);
 
   virtual ~CosineCamera();
 
+  // Frames waiting to be published, and the most seen since start.
+  int frameRingDepth() const {return ring_.Depth();}
+  int peakFrameRingDepth() const {return peak_ring_depth_;}
+
+  // Number of times a frame arrived with the ring full.
+  int64_t frameRingOverflows() const {return ring_overflows_;}
+
+  // Number of times the pipeline has run out of free buffers.
+  int64_t starvationEvents() const {return starvation_events_;}
+
+  // Number of times no frame arrived within a few expected intervals and
+  // the stream was restarted.
+  int64_t stallEvents() const {return stall_events_;}
+
+  // Latest snapshot from the statistics sampler.
+  StreamStatistics streamStatistics() const;
+
+  // Number of times the driver has reconnected after losing the camera,
+  // and how long the last reconnection took in microseconds.
+  int64_t recoveries() const {return recoveries_;}
+  int64_t lastRecoveryTime() const {return last_recovery_time_;}
+
+  // Time in microseconds from the last Start() to the first frame, and how
+  // long the last Stop() took.
+  int64_t startLatency() const {return start_latency_;}
+  int64_t stopLatency() const {return stop_latency_;}
+
+  // State of the acquisition thread. Start() moves from idle to opening,
+  // and the thread on to streaming once acquisition has started. A lost
+  // camera or failed start moves to recovering and back to streaming when
+  // reconnected. Stop() moves any state to stopping and then idle.
+  enum class AcquisitionState {idle, opening, streaming, recovering, stopping};
+
+  struct StateTransition
+  {
+    AcquisitionState from;
+    AcquisitionState to;
+
+    // Host time in microseconds since epoch.
+    int64_t time;
+
+    const char* reason;
+  };
+
+  AcquisitionState acquisitionState() const {return state_;}
+
+  // Most recent state transitions, oldest first.
+  std::vector<StateTransition> stateTransitions() const;
+
+  // Highest frame rate the link sustains with the current payload, packet
+  // size, packet delay and link speed, in Hz.
+  double maxFrameRate() const;
+
+  // Timing of a published frame.
+  struct FrameTiming
+  {
+    // GVSP block ID and device timestamp in ticks.
+    uint64_t block_id;
+    uint64_t device_timestamp;
+
+    // Host time of the device timestamp in microseconds since epoch, and
+    // its estimated error. Without a clock model, the host time the frame
+    // was published at.
+    int64_t host_time;
+    double error;
+    bool synchronized;
+  };
+
+  // Timing of the frame most recently handed to send_sample(). A
+  // synchronized host time is also the timestamp of the sample.
+  FrameTiming frameTiming() const;
+
+  // Time spent in each phase of the last connection in microseconds.
+  struct ConnectTiming
+  {
+    // Whether the camera was reached at its cached address.
+    bool cached;
+
+    // Connecting to the cached address and checking that the camera there
+    // is the named one. Zero if no address was cached.
+    int64_t direct;
+    int64_t verify;
+
+    // Finding the camera by name. Zero if the cached address was used.
+    int64_t discovery;
+
+    // Reading parameters and setting up transport and pixel format.
+    int64_t setup;
+
+    int64_t total;
+  };
+
+  ConnectTiming connectTiming() const;
+
+  // Parameter writes run by the control thread.
+  CommandQueue::Statistics commandStatistics() const {return control_.statistics();}
+
 protected:
 
   // Camera control
@@ -97,25 +272,188 @@ protected:
   // Inherited from PvDeviceEventSink.
   virtual void OnLinkDisconnected(PvDevice* aDevice);
 
+  // Inherited from PvGenEventSink.
+  virtual void OnParameterUpdate(PvGenParameter* aParameter);
+
+public:
+
+  // A device parameter resolved to its GenICam node. The change count is
+  // bumped by the GenICam change callback, and anything cached about the
+  // parameter is valid only while its recorded count matches.
+  struct ParameterBase
+  {
+    explicit ParameterBase(const char* n) : name(n), generic(NULL), changes(1) {}
+    virtual ~ParameterBase() {}
+
+    // Forgets the nodes of a freed device.
+    virtual void release() {generic = NULL;}
+
+    const char* name;
+    PvGenParameter* generic;
+    std::atomic<uint64_t> changes;
+  };
+
+  // Parameter with its typed node.
+  template<typename T>
+  struct Parameter : public ParameterBase
+  {
+    explicit Parameter(const char* n) : ParameterBase(n), node(NULL) {}
+
+    void release() {ParameterBase::release(); node = NULL;}
+
+    T* node;
+  };
+
+  // Range of an integer parameter.
+  struct IntRange
+  {
+    int64_t min;
+    int64_t max;
+    int64_t increment;
+  };
+
+  // Parameter with a cached value of type V.
+  template<typename T, typename V>
+  struct ValueParameter : public Parameter<T>
+  {
+    explicit ValueParameter(const char* n) : Parameter<T>(n), value_changes(0), value() {}
+
+    mutable uint64_t value_changes;
+    mutable V value;
+  };
+
+  struct IntParameter : public ValueParameter<PvGenInteger, int64_t>
+  {
+    explicit IntParameter(const char* n) : ValueParameter<PvGenInteger, int64_t>(n), range_changes(0) {}
+
+    mutable uint64_t range_changes;
+    mutable IntRange range;
+  };
+
+  struct EnumParameter : public ValueParameter<PvGenEnum, std::string>
+  {
+    explicit EnumParameter(const char* n) : ValueParameter<PvGenEnum, std::string>(n), options_changes(0) {}
+
+    mutable uint64_t options_changes;
+    mutable std::vector<std::string> options;
+  };
+
+  typedef ValueParameter<PvGenBoolean, bool> BoolParameter;
+  typedef Parameter<PvGenCommand> CommandParameter;
+
+  // Parameter changes that are validated together and written in
+  // dependency order by applyConfiguration().
+  class ConfigBatch
+  {
+  public:
+
+    void set(const IntParameter& parameter, int64_t value);
+    void set(const EnumParameter& parameter, const std::string& value);
+    void set(const BoolParameter& parameter, bool value);
+
+    bool empty() const {return changes_.empty();}
+
+  private:
+
+    friend class CosineCamera;
+
+    struct Change
+    {
+      const ParameterBase* parameter;
+      const IntParameter* integer;
+      const EnumParameter* enumeration;
+      const BoolParameter* boolean;
+
+      int64_t int_value;
+      std::string enum_value;
+      bool bool_value;
+    };
+
+    std::vector<Change> changes_;
+  };
+
 private:
 
+  // All parameters used by the driver, resolved at Open().
+  struct DeviceParameters
+  {
+    DeviceParameters();
+
+    IntParameter sensor_width;
+    IntParameter sensor_height;
+    IntParameter width;
+    IntParameter height;
+    IntParameter offset_x;
+    IntParameter offset_y;
+    IntParameter shutter_time;
+    IntParameter max_shutter_time;
+    IntParameter gain;
+    IntParameter trigger_interval;
+
+    EnumParameter acquisition_mode;
+    EnumParameter trigger_mode;
+    EnumParameter auto_exposure;
+    EnumParameter source_selector;
+    EnumParameter pixel_format;
+
+    BoolParameter auto_shutter_time;
+    BoolParameter auto_gain;
+
+    CommandParameter acquisition_start;
+    CommandParameter acquisition_stop;
+
+    IntParameter packet_size;
+    IntParameter packet_delay;
+    IntParameter link_speed;
+
+    IntParameter timestamp_tick_frequency;
+    IntParameter timestamp_value;
+    CommandParameter timestamp_latch;
+
+    std::vector<IntParameter*> integers;
+    std::vector<EnumParameter*> enums;
+    std::vector<ParameterBase*> all;
+  };
+
   const int trigger_scale_;
+  const Options options_;
 
   void collectParameters();
+  void releaseParameters();
+
+  IntRange getRange(const IntParameter& parameter) const;
+  std::vector<std::string> getEnumOptions(const EnumParameter& parameter) const;
+
+  template<typename P, typename V>
+  bool getCachedValue(const P& parameter, V& value, uint64_t& changes) const;
+
+  template<typename P, typename V>
+  void setCachedValue(const P& parameter, const V& value, uint64_t changes) const;
+
+  int64_t getParameter(const IntParameter& parameter, bool cached = true) const;
+  int64_t getMaxParameter(const IntParameter& parameter) const;
+  int64_t getMinParameter(const IntParameter& parameter) const;
+
+  std::string checkIntParameter(const IntParameter& parameter, int64_t value) const;
+  bool setIntParameter(const IntParameter& parameter, int64_t value);
 
-  int64_t getParameter(PvString whichParameter) const;
-  int64_t getMaxParameter(PvString whichParameter) const;
-  int64_t getMinParameter(PvString whichParameter) const;
+  bool getBooleanParameter(const BoolParameter& parameter) const;
+  void setBooleanParameter(const BoolParameter& parameter, bool status);
 
-  bool setIntParameter(PvString whichParameter, int64_t value);
+  std::string getEnum(const EnumParameter& parameter) const;
+  void setEnum(const EnumParameter& parameter, PvString value, bool dontCheckParameter = false);
 
-  bool getBooleanParameter(PvString whichParameter) const;
-  void setBooleanParameter(PvString whichParameter, bool status);
+  bool isEnumOption(const EnumParameter& parameter, PvString value) const;
+  bool checkIfEnumOptionIsOK(const EnumParameter& parameter, PvString value) const;
 
-  std::string getEnum(PvString whichParameter) const;
-  void setEnum(PvString whichParameter, PvString value, bool dontCheckParameter = false);
+  template<typename P, typename V>
+  void rememberWrite(const P& parameter, const V& value);
 
-  bool checkIfEnumOptionIsOK(PvString whichParameter, PvString value) const;
+  void replayConfiguration();
+
+  int changeOrder(const ConfigBatch::Change& change) const;
+  void writeChange(const ConfigBatch::Change& change);
+  void applyConfiguration(const ConfigBatch& batch);
 
   double raw_to_gain(int64_t raw) const;
   int64_t gain_to_raw(double gain) const;
@@ -126,38 +464,178 @@ private:
   int64_t to_trigger ( int64_t period );
   int64_t to_period ( int64_t trigger );
 
-  void updateRegion();
+  void selectPixelFormat();
+
+  int64_t alignDown(const IntParameter& parameter, int64_t value) const;
+  void updateRegion(int64_t width, int64_t height, int64_t offset_x, int64_t offset_y);
+  void resizeBuffers();
+
+  int bufferCount(int64_t payload_size) const;
+  void checkStarvation();
+
+  std::unique_lock<std::recursive_mutex> lockDevice(const char* caller) const;
+  bool isConnected() const;
+
+  void ConnectDevice();
+  PvDevice* ConnectCached(const std::string& ip, const std::string& mac, ConnectTiming& timing);
+  void SetupDevice();
+  bool Reconnect();
+  bool waitRunning(std::chrono::milliseconds timeout);
+
+  bool isRunning() const;
+  bool setState(AcquisitionState state, const char* reason);
+  void recordState(AcquisitionState state, const char* reason);
 
   bool OpenStream();
   void CloseStream();
+  bool isStreamOpen() const;
+  void drainPipeline();
+
+  bool StartStreaming();
+  void PauseStreaming();
 
   bool StartAcquisition();
   bool StopAcquisition();
 
   void SamplingLoop();
+  void acquireFrame();
+  void restartStream();
+  PvResult retrieveBuffer(PvBuffer** aBuffer, PvResult* aOperationResult);
+
+  void StartPublisher();
+  void StopPublisher();
+
+  void PublishLoop();
+
+  void queueFrame(PvBuffer* buffer);
+
+  void StartStatistics();
+  void StopStatistics();
+
+  void StatisticsLoop();
+  void sampleStatistics();
+
+  void applyResendSettings();
+
+  void configureTransport();
+  void startDelayTuning(int64_t payload_size);
+  void tuneDelay(const LossCounters& loss);
+
+  void joinLink();
+  void coordinateLink();
+
+  double tickFrequency() const;
+
+  BandwidthModel bandwidthModel() const;
+  std::string checkPeriod(int64_t period_us) const;
+
+  void resetClock();
+  void synchronizeClock();
+
+  void publishFrame(PvBuffer* buffer);
 
   void DisconnectDevice();
   void TearDown(bool aStopAcquisition);
 
-  bool mConnectionLost;
+  void submitWrite(const std::string& key, CommandQueue::Command command);
+
+  std::atomic<bool> mConnectionLost;
 
   PvString mConnectionID;
 
+  // Guards the device and the parameter nodes, which are freed when the
+  // link is lost. Held by every parameter access, and while the device is
+  // set up or freed. Never taken while holding cache_mutex_ or run_mutex_.
+  mutable std::recursive_mutex device_mutex_;
+
   mutable PvDevice* device_;
   mutable PvGenParameterArray *lParameters;
+  DeviceParameters params_;
+
+  // Guards the cached values, ranges and enum options in params_.
+  mutable std::mutex cache_mutex_;
+
+  // Parameter being written by the driver, its own update is not a change.
+  std::atomic<PvGenParameter*> writing_;
+
+  // Last value written to each parameter, replayed after a reconnect.
+  std::mutex written_mutex_;
+  std::map<const ParameterBase*, ConfigBatch::Change> written_;
 
   PvStream* mStream;
   PvPipeline* mPipeline;
   PvString fetched_ipaddress;
 
-  bool running_;
+  std::atomic<AcquisitionState> state_;
   std::thread thread_;
 
+  // Guards state changes, the transition history and the stream handle
+  // against Stop() and link loss, which wake the sampling thread from
+  // reconnect backoff or a buffer wait.
+  mutable std::mutex run_mutex_;
+  std::condition_variable run_cond_;
+  std::deque<StateTransition> transitions_;
+
+  std::atomic<int64_t> recoveries_;
+  std::atomic<int64_t> last_recovery_time_;
+
+  std::chrono::steady_clock::time_point start_time_;
+  bool first_frame_pending_;
+  std::atomic<int64_t> start_latency_;
+  std::atomic<int64_t> stop_latency_;
+
   int timeout_;
+  LogRateLimiter timeout_log_;
+
+  std::vector<unsigned char> staging_;
+  std::atomic<bool> resize_pending_;
+  PackedFormat packed_format_;
+
+  FrameRing<PvBuffer*> ring_;
+  std::atomic<bool> publishing_;
+  std::thread publish_thread_;
+  std::atomic<int> peak_ring_depth_;
+  std::atomic<int64_t> ring_overflows_;
+
+  bool starving_;
+  std::atomic<int64_t> starvation_events_;
+
+  // Owned by the sampling thread, with the period it was reset from.
+  StallDetector stall_;
+  int64_t stall_period_;
+  std::atomic<int64_t> stall_events_;
+  std::atomic<int64_t> frame_interval_;
+
+  bool sampling_stats_;
+  std::thread stats_thread_;
+  mutable std::mutex stats_mutex_;
+  std::condition_variable stats_cond_;
+  StreamStatistics stats_;
+
+  FrameLossTracker loss_;
+  LossWindow loss_window_;
+  ResendPolicy resend_;
+  DelayTuner delay_tuner_;
+  LinkCoordinator link_;
+
+  // Maps device ticks to steady clock time, and the offset from steady
+  // clock to system clock in microseconds taken when it was reset.
+  ClockModel clock_;
+  std::atomic<int64_t> clock_epoch_;
+  mutable std::mutex timing_mutex_;
+  FrameTiming timing_;
+  ConnectTiming connect_timing_;
 
   bool samplingErrorFlag;
   char samplingErrorText[30];
 
+  // Whether the last failed StartStreaming() may succeed if retried, as
+  // after a network error, rather than fail the same way again.
+  bool start_transient_;
+
+  // Control thread running parameter writes from the server. Last, so it
+  // is stopped before the state its commands use is destroyed.
+  CommandQueue control_;
 };
 
 } // namespace i3ds
@@ -0,0 +1,64 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __I3DS_DELAY_TUNER_HPP
+#define __I3DS_DELAY_TUNER_HPP
+
+#include "frame_loss.hpp"
+
+#include <cstdint>
+
+namespace i3ds
+{
+
+// Searches for the smallest inter-packet delay without packet loss.
+//
+// The delay is raised while packets are lost, and the interval between the
+// largest lossy and the smallest clean delay is halved until it is within
+// one step. Loss after the search has settled starts it again from there.
+class DelayTuner
+{
+public:
+
+  DelayTuner();
+
+  // Starts a search from the initial delay, within [0, max].
+  void reset(int64_t initial, int64_t step, int64_t max);
+
+  int64_t delay() const {return delay_;}
+  bool settled() const {return settled_;}
+
+  // Updates from the latest loss counters. Returns true if the delay
+  // changed and should be written to the device.
+  bool update(const LossCounters& counters);
+
+private:
+
+  // Consecutive clean samples before a delay is taken as clean.
+  static const int clean_samples = 5;
+
+  int64_t step_;
+  int64_t max_;
+  int64_t delay_;
+
+  // Largest delay seen to lose packets, smallest seen clean, -1 if none.
+  int64_t lossy_;
+  int64_t clean_;
+
+  bool settled_;
+  int clean_count_;
+
+  bool has_last_;
+  LossCounters last_;
+};
+
+} // namespace i3ds
+
+#endif
@@ -0,0 +1,68 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __I3DS_FRAME_LOG_HPP
+#define __I3DS_FRAME_LOG_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Lowest severity logged from the per-frame path. Statements below this
+// level are removed by the compiler, so steady-state acquisition does no
+// formatting and takes no logging lock. Set from CMake with FRAME_LOG_LEVEL.
+// The macros expand to BOOST_LOG_TRIVIAL, so <boost/log/trivial.hpp> must
+// be included where they are used.
+#ifndef COSINE_FRAME_LOG_LEVEL
+#define COSINE_FRAME_LOG_LEVEL warning
+#endif
+
+#define FRAME_LOG_ENABLED(lvl) \
+  (::boost::log::trivial::lvl >= ::boost::log::trivial::COSINE_FRAME_LOG_LEVEL)
+
+// Per-frame log statement, compiled out below COSINE_FRAME_LOG_LEVEL.
+#define FRAME_LOG(lvl) \
+  if (!FRAME_LOG_ENABLED(lvl)) {} else BOOST_LOG_TRIVIAL(lvl)
+
+// As FRAME_LOG, but at most once per period of the given LogRateLimiter.
+#define FRAME_LOG_LIMITED(lvl, limiter) \
+  if (!FRAME_LOG_ENABLED(lvl) || !(limiter).allow()) {} else BOOST_LOG_TRIVIAL(lvl)
+
+namespace i3ds
+{
+
+// Lets a log statement through at most once per period, without locking.
+class LogRateLimiter
+{
+public:
+
+  explicit LogRateLimiter(std::chrono::milliseconds period)
+    : period_(std::chrono::duration_cast<std::chrono::steady_clock::duration>(period).count()),
+      next_(0)
+  {
+  }
+
+  bool allow()
+  {
+    const int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+    int64_t next = next_.load(std::memory_order_relaxed);
+
+    return now >= next && next_.compare_exchange_strong(next, now + period_, std::memory_order_relaxed);
+  }
+
+private:
+
+  const int64_t period_;
+  std::atomic<int64_t> next_;
+};
+
+} // namespace i3ds
+
+#endif
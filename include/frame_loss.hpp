@@ -0,0 +1,236 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __I3DS_FRAME_LOSS_HPP
+#define __I3DS_FRAME_LOSS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+
+namespace i3ds
+{
+
+// How a frame left the pipeline.
+enum class FrameOutcome
+{
+  good,
+
+  // Delivered with packets missing after resends, or otherwise damaged.
+  incomplete,
+
+  // Not completed by the stream within its block timeout.
+  timed_out
+};
+
+// Cumulative frame and packet loss counters.
+struct LossCounters
+{
+  LossCounters()
+    : good(0), dropped(0), incomplete(0), timed_out(0), missing_packets(0), recovered_packets(0)
+  {
+  }
+
+  int64_t lost() const {return dropped + incomplete + timed_out;}
+  int64_t frames() const {return good + lost();}
+
+  int64_t good;
+
+  // Frames never delivered at all, seen as gaps in the block IDs.
+  int64_t dropped;
+
+  int64_t incomplete;
+  int64_t timed_out;
+
+  // Packets lost for good, and packets recovered by resend.
+  int64_t missing_packets;
+  int64_t recovered_packets;
+};
+
+// Accounts for frames by their GVSP block ID. Written by the sampling
+// thread, read by anyone.
+class FrameLossTracker
+{
+public:
+
+  FrameLossTracker()
+  {
+    reset();
+  }
+
+  // Forgets the last block ID, e.g. when the stream is restarted.
+  void reset()
+  {
+    has_last_ = false;
+    last_block_id_ = 0;
+  }
+
+  void frame(uint64_t block_id, FrameOutcome outcome, uint32_t missing_packets, uint32_t recovered_packets)
+  {
+    dropped_ += gap(block_id);
+
+    switch (outcome)
+      {
+      case FrameOutcome::good:
+        good_++;
+        break;
+
+      case FrameOutcome::incomplete:
+        incomplete_++;
+        break;
+
+      case FrameOutcome::timed_out:
+        timed_out_++;
+        break;
+      }
+
+    missing_packets_ += missing_packets;
+    recovered_packets_ += recovered_packets;
+  }
+
+  LossCounters counters() const
+  {
+    LossCounters c;
+
+    c.good = good_;
+    c.dropped = dropped_;
+    c.incomplete = incomplete_;
+    c.timed_out = timed_out_;
+    c.missing_packets = missing_packets_;
+    c.recovered_packets = recovered_packets_;
+
+    return c;
+  }
+
+private:
+
+  // Largest gap taken as lost frames rather than a restarted device.
+  static const uint64_t max_gap = 1 << 20;
+
+  // Frames missing between the last block ID and this one. GEV 1.x block
+  // IDs are 16 bits and skip zero when they wrap.
+  int64_t gap(uint64_t block_id)
+  {
+    const bool had_last = has_last_;
+    const uint64_t last = last_block_id_;
+
+    has_last_ = true;
+    last_block_id_ = block_id;
+
+    if (!had_last)
+      {
+        return 0;
+      }
+
+    if (block_id > last && block_id - last <= max_gap)
+      {
+        return (int64_t) (block_id - last - 1);
+      }
+
+    if (block_id < last && last <= 0xFFFF)
+      {
+        const uint64_t wrapped = (0xFFFF - last) + (block_id - 1);
+
+        if (wrapped <= 0x100)
+          {
+            return (int64_t) wrapped;
+          }
+      }
+
+    return 0;
+  }
+
+  bool has_last_;
+  uint64_t last_block_id_;
+
+  std::atomic<int64_t> good_ {0};
+  std::atomic<int64_t> dropped_ {0};
+  std::atomic<int64_t> incomplete_ {0};
+  std::atomic<int64_t> timed_out_ {0};
+  std::atomic<int64_t> missing_packets_ {0};
+  std::atomic<int64_t> recovered_packets_ {0};
+};
+
+// Loss rates over a trailing time window, from periodic counter samples.
+class LossWindow
+{
+public:
+
+  explicit LossWindow(std::chrono::steady_clock::duration span)
+    : span_(span)
+  {
+  }
+
+  void add(std::chrono::steady_clock::time_point time, const LossCounters& counters)
+  {
+    samples_.push_back(Sample {time, counters});
+
+    // Keep one sample at or beyond the span as the window start.
+    while (samples_.size() > 2 && time - samples_[1].time >= span_)
+      {
+        samples_.pop_front();
+      }
+  }
+
+  // Fraction of frames lost in the window.
+  double frameLossRate() const
+  {
+    if (samples_.size() < 2)
+      {
+        return 0.0;
+      }
+
+    const int64_t frames = samples_.back().counters.frames() - samples_.front().counters.frames();
+    const int64_t lost = samples_.back().counters.lost() - samples_.front().counters.lost();
+
+    return frames > 0 ? (double) lost / frames : 0.0;
+  }
+
+  // Packets lost for good per second in the window.
+  double missingPacketRate() const
+  {
+    return perSecond(&LossCounters::missing_packets);
+  }
+
+  // Packets recovered by resend per second in the window.
+  double recoveredPacketRate() const
+  {
+    return perSecond(&LossCounters::recovered_packets);
+  }
+
+private:
+
+  struct Sample
+  {
+    std::chrono::steady_clock::time_point time;
+    LossCounters counters;
+  };
+
+  double perSecond(int64_t LossCounters::*counter) const
+  {
+    if (samples_.size() < 2)
+      {
+        return 0.0;
+      }
+
+    const int64_t count = samples_.back().counters.*counter - samples_.front().counters.*counter;
+    const std::chrono::duration<double> elapsed = samples_.back().time - samples_.front().time;
+
+    return elapsed.count() > 0.0 ? count / elapsed.count() : 0.0;
+  }
+
+  const std::chrono::steady_clock::duration span_;
+  std::deque<Sample> samples_;
+};
+
+} // namespace i3ds
+
+#endif
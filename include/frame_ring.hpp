@@ -0,0 +1,203 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __I3DS_FRAME_RING_HPP
+#define __I3DS_FRAME_RING_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <stdexcept>
+
+namespace i3ds
+{
+
+// What to do when a frame arrives and the ring is full.
+enum class OverflowPolicy
+{
+  drop_oldest,
+  drop_newest,
+  block
+};
+
+// Bounded lock-free single-producer/single-consumer ring of frame handles.
+//
+// The handle type must be trivially copyable (e.g. a raw pointer). Both
+// sides may pop, which lets the producer discard the oldest entry when the
+// ring is full. Whoever pops a handle owns it. The mutex and condition
+// variable are only used to park a side that has nothing to do.
+template<typename T>
+class FrameRing
+{
+public:
+
+  // Largest capacity a ring may be created with.
+  static const size_t max_capacity = 1 << 16;
+
+  // Capacity is rounded up to a power of two. Throws if it is zero or
+  // larger than max_capacity.
+  explicit FrameRing(size_t capacity)
+    : capacity_(round_up(checked(capacity))),
+      mask_(capacity_ - 1),
+      slots_(new std::atomic<T>[capacity_]),
+      head_(0),
+      tail_(0),
+      waiters_(0),
+      interrupted_(false)
+  {
+  }
+
+  size_t Capacity() const {return capacity_;}
+
+  size_t Depth() const
+  {
+    return head_.load() - tail_.load();
+  }
+
+  // Producer only. Returns false if the ring is full.
+  bool TryPush(T item)
+  {
+    const size_t head = head_.load(std::memory_order_relaxed);
+
+    if (head - tail_.load(std::memory_order_acquire) >= capacity_)
+      {
+        return false;
+      }
+
+    slots_[head & mask_].store(item, std::memory_order_relaxed);
+    head_.store(head + 1);
+
+    notify();
+
+    return true;
+  }
+
+  // Either side. Returns false if the ring is empty.
+  bool TryPop(T& item)
+  {
+    size_t tail = tail_.load(std::memory_order_acquire);
+
+    while (tail != head_.load(std::memory_order_acquire))
+      {
+        item = slots_[tail & mask_].load(std::memory_order_relaxed);
+
+        if (tail_.compare_exchange_weak(tail, tail + 1, std::memory_order_acq_rel))
+          {
+            notify();
+            return true;
+          }
+      }
+
+    return false;
+  }
+
+  // Consumer only. Waits up to timeout for an item.
+  bool WaitPop(T& item, std::chrono::milliseconds timeout)
+  {
+    if (TryPop(item))
+      {
+        return true;
+      }
+
+    wait(timeout, [this]() {return Depth() > 0;});
+
+    return TryPop(item);
+  }
+
+  // Producer only. Waits up to timeout for a free slot.
+  bool WaitSpace(std::chrono::milliseconds timeout)
+  {
+    if (Depth() < capacity_)
+      {
+        return true;
+      }
+
+    wait(timeout, [this]() {return Depth() < capacity_;});
+
+    return Depth() < capacity_;
+  }
+
+  // Wakes any waiting side and makes further waits return at once.
+  void Interrupt()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    interrupted_ = true;
+    cond_.notify_all();
+  }
+
+  void Reset()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    interrupted_ = false;
+  }
+
+private:
+
+  static size_t checked(size_t capacity)
+  {
+    if (capacity < 1 || capacity > max_capacity)
+      {
+        throw std::invalid_argument("Frame ring capacity out of range");
+      }
+
+    return capacity;
+  }
+
+  static size_t round_up(size_t n)
+  {
+    size_t p = 1;
+
+    while (p < n)
+      {
+        p <<= 1;
+      }
+
+    return p;
+  }
+
+  template<typename Predicate>
+  void wait(std::chrono::milliseconds timeout, Predicate ready)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    waiters_++;
+    cond_.wait_for(lock, timeout, [&]() {return interrupted_ || ready();});
+    waiters_--;
+  }
+
+  void notify()
+  {
+    if (waiters_.load() > 0)
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cond_.notify_all();
+      }
+  }
+
+  const size_t capacity_;
+  const size_t mask_;
+
+  std::unique_ptr<std::atomic<T>[]> slots_;
+
+  alignas(64) std::atomic<size_t> head_;
+  alignas(64) std::atomic<size_t> tail_;
+
+  std::atomic<int> waiters_;
+  bool interrupted_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+};
+
+} // namespace i3ds
+
+#endif
@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __I3DS_LINK_COORDINATOR_HPP
+#define __I3DS_LINK_COORDINATOR_HPP
+
+#include <cstdint>
+#include <string>
+
+namespace i3ds
+{
+
+// Divides a link shared by camera streams in several processes on the
+// host.
+//
+// Streams register their bandwidth demand in a table in POSIX shared
+// memory, guarded by a process-shared robust mutex. The link is divided in
+// proportion to demand, so that when each stream paces its packets to its
+// share, the streams together never send faster than the link carries and
+// their bursts do not pile up in the switch. Entries of processes that
+// have died are removed.
+class LinkCoordinator
+{
+public:
+
+  LinkCoordinator();
+  ~LinkCoordinator();
+
+  // Opens the table for the named link, creating it if needed. Returns
+  // false with errno set on failure.
+  bool open(const std::string& name);
+  void close();
+
+  bool isOpen() const {return link_ != NULL;}
+
+  // Registers or updates the demand of this stream in Mbit/s, on a link
+  // of the given capacity. Returns false if the table is full.
+  bool join(double demand, double capacity);
+
+  // Removes this stream from the table.
+  void leave();
+
+  // Returns true if the division has changed since the last call, and
+  // gives the share of this stream in Mbit/s and the number of streams.
+  bool update(double& share, int& streams);
+
+private:
+
+  struct Link;
+
+  class Lock;
+
+  void divide();
+  void purge();
+
+  Link* link_;
+  int slot_;
+  uint64_t generation_;
+};
+
+} // namespace i3ds
+
+#endif
@@ -0,0 +1,83 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __I3DS_PIXEL_KERNELS_HPP
+#define __I3DS_PIXEL_KERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace i3ds
+{
+
+// Layouts of 12-bit pixels packed two to three bytes.
+enum class PackedFormat
+{
+  none,
+
+  // GigE Vision Mono12Packed: high bits of each pixel in its own byte,
+  // low nibbles of both pixels in the middle byte.
+  mono12packed,
+
+  // PFNC Mono12p: pixels packed LSB first.
+  mono12p
+};
+
+// Number of bytes holding the given number of packed 12-bit pixels.
+inline size_t packed12_size(size_t pixels)
+{
+  return (pixels * 3 + 1) / 2;
+}
+
+// Table of pixel conversion kernels for one instruction set. All kernels
+// give the same result as the scalar ones.
+struct PixelKernels
+{
+  const char* name;
+
+  // Unpacks 12-bit pixels to 16-bit, LSB aligned.
+  void (*unpack_mono12packed)(const uint8_t* src, uint16_t* dst, size_t pixels);
+  void (*unpack_mono12p)(const uint8_t* src, uint16_t* dst, size_t pixels);
+
+  // 16-bit to 8-bit by right shift, saturating at 255.
+  void (*shift_to_8)(const uint16_t* src, uint8_t* dst, size_t pixels, int shift);
+
+  // 16-bit to 8-bit by mapping [low, high] linearly onto [0, 255].
+  void (*window_to_8)(const uint16_t* src, uint8_t* dst, size_t pixels, uint16_t low, uint16_t high);
+
+  // Moves pixels of the given bit depth to the MSB or LSB end of 16 bits.
+  // May be done in place.
+  void (*align_msb)(const uint16_t* src, uint16_t* dst, size_t pixels, int depth);
+  void (*align_lsb)(const uint16_t* src, uint16_t* dst, size_t pixels, int depth);
+};
+
+// Fastest kernels supported by this CPU, chosen once at first use.
+const PixelKernels& pixel_kernels();
+
+// Portable reference kernels.
+const PixelKernels& scalar_pixel_kernels();
+
+// All kernel tables this CPU can run, the scalar ones first.
+std::vector<const PixelKernels*> supported_pixel_kernels();
+
+inline void unpack_mono12packed(const uint8_t* src, uint16_t* dst, size_t pixels)
+{
+  pixel_kernels().unpack_mono12packed(src, dst, pixels);
+}
+
+inline void unpack_mono12p(const uint8_t* src, uint16_t* dst, size_t pixels)
+{
+  pixel_kernels().unpack_mono12p(src, dst, pixels);
+}
+
+} // namespace i3ds
+
+#endif
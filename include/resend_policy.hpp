@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __I3DS_RESEND_POLICY_HPP
+#define __I3DS_RESEND_POLICY_HPP
+
+#include "frame_loss.hpp"
+
+#include <chrono>
+
+namespace i3ds
+{
+
+// Missing packet resend settings of a GigE Vision stream.
+struct ResendSettings
+{
+  bool enabled;
+
+  // Wait before requesting a missing packet, in case it is just late (ms).
+  int delay;
+
+  // Wait for a requested packet before asking again (ms).
+  int timeout;
+
+  // Requests per missing packet.
+  int retries;
+
+  bool operator==(const ResendSettings& other) const
+  {
+    return enabled == other.enabled && delay == other.delay && timeout == other.timeout
+           && retries == other.retries;
+  }
+
+  bool operator!=(const ResendSettings& other) const {return !(*this == other);}
+};
+
+// Turns packet resend on and off from the observed loss, keeping the time
+// a frame may be held back by resends within a latency bound.
+//
+// Resend is enabled when packets are lost, and disabled again after a
+// long loss free period. If resend does not deliver more frames than
+// running without it, as on a congested link where resend requests add to
+// the load, it is disabled and not tried again for a while. When packets
+// are still lost with resend on, more retries are allowed while they fit
+// in the latency bound.
+class ResendPolicy
+{
+public:
+
+  // Latency bound in milliseconds, zero to never resend.
+  explicit ResendPolicy(int latency_bound);
+
+  const ResendSettings& settings() const {return settings_;}
+
+  // Updates from the latest loss counters. Returns true if the settings
+  // changed and should be written to the stream.
+  bool update(std::chrono::steady_clock::time_point now, const LossCounters& counters);
+
+private:
+
+  void enable();
+  void disable();
+
+  const int latency_bound_;
+  const int max_retries_;
+
+  ResendSettings settings_;
+
+  bool has_last_;
+  LossCounters last_;
+
+  // Samples in the current state, and samples without any loss.
+  int samples_;
+  int quiet_;
+
+  // Frame loss ratio with resend off, to compare against with it on.
+  double loss_without_;
+
+  // Frames and losses counted since resend was enabled.
+  int64_t frames_with_;
+  int64_t lost_with_;
+
+  std::chrono::steady_clock::time_point retry_after_;
+};
+
+} // namespace i3ds
+
+#endif
@@ -0,0 +1,74 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef __I3DS_STALL_DETECTOR_HPP
+#define __I3DS_STALL_DETECTOR_HPP
+
+#include <cstdint>
+
+namespace i3ds
+{
+
+// Learns the interval between frames from their arrivals, starting from
+// the configured trigger period, and derives how long to wait for a frame
+// before the stream is taken as stalled.
+//
+// The interval is a moving average that weighs early samples equally, so
+// a wrong configured period is corrected within a few frames. The timeout
+// is a few intervals, and doubles with each stall until an interval is
+// measured again, so a camera without triggers is not restarted
+// continuously.
+class StallDetector
+{
+public:
+
+  StallDetector();
+
+  // Starts over from the configured period in microseconds.
+  void reset(int64_t period_us);
+
+  // A frame arrived at the given host time in microseconds.
+  void arrival(int64_t time_us);
+
+  // No frame arrived within timeout().
+  void stall();
+
+  // Expected interval between frames in microseconds.
+  int64_t interval() const {return (int64_t) interval_;}
+
+  // Whether an interval has been measured since the reset, rather than
+  // only configured.
+  bool learned() const {return learned_;}
+
+  // Time to wait for a frame before a stall in milliseconds.
+  int timeout() const;
+
+private:
+
+  // Intervals a frame may be late before the stream has stalled.
+  static const int missed_periods = 4;
+
+  // Samples after which the average stops weighing them equally.
+  static const int average_samples = 8;
+
+  static const int min_timeout = 20;
+  static const int max_timeout = 10000;
+
+  double interval_;
+  int samples_;
+  bool learned_;
+  int64_t last_;
+  int backoff_;
+};
+
+} // namespace i3ds
+
+#endif
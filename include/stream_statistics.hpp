@@ -0,0 +1,89 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __I3DS_STREAM_STATISTICS_HPP
+#define __I3DS_STREAM_STATISTICS_HPP
+
+#include <cstdint>
+#include <chrono>
+
+#include "frame_loss.hpp"
+
+namespace i3ds
+{
+
+// Snapshot of stream and pipeline statistics, taken by the background
+// sampler of the camera driver.
+struct StreamStatistics
+{
+  StreamStatistics()
+    : block_count(0),
+      acquisition_rate(0.0),
+      bandwidth(0.0),
+      buffer_count(0),
+      ring_depth(0),
+      ring_overflows(0),
+      starvation_events(0),
+      frame_interval(0),
+      stall_events(0),
+      clock_drift(0.0),
+      clock_error(0.0),
+      frame_loss_rate(0.0),
+      missing_packet_rate(0.0),
+      recovered_packet_rate(0.0),
+      resend_enabled(false),
+      recoveries(0),
+      last_recovery_time(0)
+  {
+  }
+
+  // When the snapshot was taken.
+  std::chrono::steady_clock::time_point sampled;
+
+  // Counters reported by the eBUS stream.
+  int64_t block_count;
+  double acquisition_rate;
+  double bandwidth;
+
+  // Buffer usage on the host.
+  int64_t buffer_count;
+  int64_t ring_depth;
+  int64_t ring_overflows;
+  int64_t starvation_events;
+
+  // Learned interval between frames in microseconds, and the number of
+  // times the stream stalled and was restarted.
+  int64_t frame_interval;
+  int64_t stall_events;
+
+  // Device clock rate relative to the host in ppm, and the estimated
+  // error of device to host time mapping in microseconds.
+  double clock_drift;
+  double clock_error;
+
+  // Frame and packet loss since the driver started, and over the
+  // trailing loss window: fraction of frames lost, and packets per second.
+  LossCounters loss;
+  double frame_loss_rate;
+  double missing_packet_rate;
+  double recovered_packet_rate;
+
+  // Whether missing packets are currently requested again.
+  bool resend_enabled;
+
+  // Reconnections after losing the camera, and the duration of the last
+  // one in microseconds.
+  int64_t recoveries;
+  int64_t last_recovery_time;
+};
+
+} // namespace i3ds
+
+#endif
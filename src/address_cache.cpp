@@ -0,0 +1,108 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "address_cache.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+
+#include <sys/stat.h>
+
+// Creates the directory and its parents, like mkdir -p.
+static bool
+make_directories(const std::string& path)
+{
+  for (size_t i = 1; i <= path.size(); i++)
+    {
+      if (i == path.size() || path[i] == '/')
+        {
+          const std::string part = path.substr(0, i);
+
+          if (mkdir(part.c_str(), 0755) != 0 && errno != EEXIST)
+            {
+              return false;
+            }
+        }
+    }
+
+  return true;
+}
+
+// Keeps the camera name from escaping the cache directory.
+static std::string
+file_name(const std::string& camera_name)
+{
+  std::string name = camera_name;
+
+  for (char& c : name)
+    {
+      if (c == '/' || c == '\0')
+        {
+          c = '_';
+        }
+    }
+
+  return "cosine_" + name + ".address";
+}
+
+i3ds::AddressCache::AddressCache(const std::string& directory, const std::string& camera_name)
+  : directory_(directory)
+{
+  if (!directory.empty() && !camera_name.empty())
+    {
+      path_ = directory + "/" + file_name(camera_name);
+    }
+}
+
+bool
+i3ds::AddressCache::load(std::string& ip, std::string& mac) const
+{
+  if (!enabled())
+    {
+      return false;
+    }
+
+  std::ifstream file(path_);
+
+  return static_cast<bool>(file >> ip >> mac);
+}
+
+bool
+i3ds::AddressCache::store(const std::string& ip, const std::string& mac) const
+{
+  if (!enabled() || !make_directories(directory_))
+    {
+      return false;
+    }
+
+  // Write aside and rename, so a reader never sees half a file.
+  const std::string temporary = path_ + ".tmp";
+
+  {
+    std::ofstream file(temporary);
+
+    if (!(file << ip << " " << mac << std::endl))
+      {
+        return false;
+      }
+  }
+
+  return std::rename(temporary.c_str(), path_.c_str()) == 0;
+}
+
+void
+i3ds::AddressCache::clear() const
+{
+  if (enabled())
+    {
+      std::remove(path_.c_str());
+    }
+}
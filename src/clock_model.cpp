@@ -0,0 +1,162 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "clock_model.hpp"
+
+#include <cmath>
+
+i3ds::ClockModel::ClockModel(size_t window)
+  : window_(window < 2 ? 2 : window)
+{
+  reset(1e6);
+}
+
+void
+i3ds::ClockModel::reset(double tick_frequency)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  tick_frequency_ = tick_frequency > 0.0 ? tick_frequency : 1e6;
+  has_origin_ = false;
+  origin_ticks_ = 0;
+  origin_host_us_ = 0;
+  points_.clear();
+  offset_ = 0.0;
+  slope_ = 1.0;
+  error_ = 0.0;
+}
+
+void
+i3ds::ClockModel::addPoint(uint64_t ticks, int64_t host_us, double uncertainty_us)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (!has_origin_)
+    {
+      has_origin_ = true;
+      origin_ticks_ = ticks;
+      origin_host_us_ = host_us;
+    }
+
+  Point point;
+
+  point.device_us = (double) (int64_t) (ticks - origin_ticks_) * 1e6 / tick_frequency_;
+  point.host_us = (double) (host_us - origin_host_us_);
+  point.uncertainty_us = uncertainty_us;
+
+  // A device clock that went backwards has been reset, start over.
+  if (!points_.empty() && point.device_us < points_.back().device_us)
+    {
+      points_.clear();
+      origin_ticks_ = ticks;
+      origin_host_us_ = host_us;
+      point.device_us = 0.0;
+      point.host_us = 0.0;
+    }
+
+  points_.push_back(point);
+
+  if (points_.size() > window_)
+    {
+      points_.pop_front();
+    }
+
+  fit();
+}
+
+//
+// Weighted least squares, trusting points taken in a short host interval
+// the most. With a single point the slope stays at the nominal rate.
+//
+void
+i3ds::ClockModel::fit()
+{
+  double sw = 0.0, sx = 0.0, sy = 0.0, uncertainty = 0.0;
+
+  for (const Point& p : points_)
+    {
+      const double w = 1.0 / (p.uncertainty_us * p.uncertainty_us + 1.0);
+
+      sw += w;
+      sx += w * p.device_us;
+      sy += w * p.host_us;
+      uncertainty += p.uncertainty_us;
+    }
+
+  const double mx = sx / sw;
+  const double my = sy / sw;
+
+  double sxx = 0.0, sxy = 0.0;
+
+  for (const Point& p : points_)
+    {
+      const double w = 1.0 / (p.uncertainty_us * p.uncertainty_us + 1.0);
+
+      sxx += w * (p.device_us - mx) * (p.device_us - mx);
+      sxy += w * (p.device_us - mx) * (p.host_us - my);
+    }
+
+  slope_ = sxx > 0.0 ? sxy / sxx : 1.0;
+  offset_ = my - slope_ * mx;
+
+  double residuals = 0.0;
+
+  for (const Point& p : points_)
+    {
+      const double r = p.host_us - (offset_ + slope_ * p.device_us);
+      residuals += r * r;
+    }
+
+  // Residual spread once there is something to fit, plus the sampling
+  // uncertainty of the points themselves.
+  const size_t n = points_.size();
+  const double spread = n > 2 ? std::sqrt(residuals / (n - 2)) : 0.0;
+
+  error_ = spread + uncertainty / n;
+}
+
+bool
+i3ds::ClockModel::toHost(uint64_t ticks, int64_t& host_us, double& error_us) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (points_.empty())
+    {
+      return false;
+    }
+
+  const double device_us = (double) (int64_t) (ticks - origin_ticks_) * 1e6 / tick_frequency_;
+
+  host_us = origin_host_us_ + (int64_t) std::llround(offset_ + slope_ * device_us);
+  error_us = error_;
+
+  return true;
+}
+
+double
+i3ds::ClockModel::drift() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return (1.0 / slope_ - 1.0) * 1e6;
+}
+
+double
+i3ds::ClockModel::error() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return error_;
+}
+
+size_t
+i3ds::ClockModel::points() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return points_.size();
+}
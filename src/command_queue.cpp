@@ -0,0 +1,232 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "command_queue.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+i3ds::CommandQueue::CommandQueue()
+  : busy_(false),
+    running_(true),
+    paused_(false),
+    stats_(),
+    total_latency_(0)
+{
+  thread_ = std::thread(&CommandQueue::run, this);
+}
+
+i3ds::CommandQueue::~CommandQueue()
+{
+  stop();
+}
+
+void
+i3ds::CommandQueue::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+  }
+
+  work_cond_.notify_all();
+
+  if (thread_.joinable())
+    {
+      thread_.join();
+    }
+}
+
+std::shared_future<void>
+i3ds::CommandQueue::submit(const std::string& key, Command command)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  if (!running_)
+    {
+      // Stopped, run it here instead.
+      lock.unlock();
+
+      std::promise<void> promise;
+
+      try
+        {
+          command();
+          promise.set_value();
+        }
+      catch (...)
+        {
+          promise.set_exception(std::current_exception());
+        }
+
+      return promise.get_future().share();
+    }
+
+  if (!key.empty())
+    {
+      auto i = std::find_if(queue_.begin(), queue_.end(),
+                            [&key](const std::shared_ptr<Entry>& e) {return e->key == key;});
+
+      if (i != queue_.end())
+        {
+          std::shared_ptr<Entry> entry = *i;
+
+          queue_.erase(i);
+          entry->command = command;
+          queue_.push_back(entry);
+
+          stats_.coalesced++;
+
+          return entry->future;
+        }
+    }
+
+  std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+
+  entry->key = key;
+  entry->command = command;
+  entry->future = entry->promise.get_future().share();
+  entry->queued = std::chrono::steady_clock::now();
+
+  queue_.push_back(entry);
+  work_cond_.notify_one();
+
+  return entry->future;
+}
+
+bool
+i3ds::CommandQueue::cancel(const std::string& key)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  auto i = std::find_if(queue_.begin(), queue_.end(),
+                        [&key](const std::shared_ptr<Entry>& e) {return !key.empty() && e->key == key;});
+
+  if (i == queue_.end())
+    {
+      return false;
+    }
+
+  std::shared_ptr<Entry> entry = *i;
+
+  queue_.erase(i);
+  stats_.cancelled++;
+
+  if (queue_.empty() && !busy_)
+    {
+      idle_cond_.notify_all();
+    }
+
+  lock.unlock();
+
+  entry->promise.set_exception(std::make_exception_ptr(std::runtime_error("Command cancelled")));
+
+  return true;
+}
+
+void
+i3ds::CommandQueue::flush()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  idle_cond_.wait(lock, [this]() {return (queue_.empty() || paused_) && !busy_;});
+}
+
+void
+i3ds::CommandQueue::pause()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  paused_ = true;
+
+  idle_cond_.wait(lock, [this]() {return !busy_;});
+}
+
+void
+i3ds::CommandQueue::resume()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    paused_ = false;
+  }
+
+  work_cond_.notify_all();
+}
+
+i3ds::CommandQueue::Statistics
+i3ds::CommandQueue::statistics() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  Statistics stats = stats_;
+
+  stats.pending = queue_.size() + (busy_ ? 1 : 0);
+  stats.mean_latency = stats.executed > 0 ? (double) total_latency_ / stats.executed : 0.0;
+
+  return stats;
+}
+
+void
+i3ds::CommandQueue::run()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (true)
+    {
+      // Stopping runs the remaining commands, also when paused.
+      work_cond_.wait(lock, [this]() {return (!queue_.empty() && !paused_) || !running_;});
+
+      if (queue_.empty())
+        {
+          break;
+        }
+
+      std::shared_ptr<Entry> entry = queue_.front();
+      queue_.pop_front();
+      busy_ = true;
+
+      lock.unlock();
+
+      bool failed = false;
+
+      try
+        {
+          entry->command();
+          entry->promise.set_value();
+        }
+      catch (...)
+        {
+          entry->promise.set_exception(std::current_exception());
+          failed = true;
+        }
+
+      const int64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(
+                                std::chrono::steady_clock::now() - entry->queued).count();
+
+      lock.lock();
+
+      busy_ = false;
+
+      stats_.executed++;
+      stats_.failed += failed;
+      stats_.max_latency = std::max(stats_.max_latency, latency);
+      total_latency_ += latency;
+
+      if (queue_.empty() || paused_)
+        {
+          idle_cond_.notify_all();
+        }
+    }
+
+  busy_ = false;
+  idle_cond_.notify_all();
+}
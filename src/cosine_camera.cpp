@@ -13,6 +13,12 @@
 #include <iomanip>
 #include <memory>
 #include <exception>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cctype>
+
+#include <arpa/inet.h>
 
 #include "cosine_camera.hpp"
 
@@ -26,15 +32,65 @@
 
 namespace logging = boost::log;
 
-i3ds::CosineCamera::CosineCamera(Context::Ptr context, NodeID id, GigECamera::Parameters param, int trigger_scale)
+// Smallest pipeline the driver will run with.
+static const int64_t MIN_BUFFER_COUNT = 4;
+
+// Publisher stall the pipeline should absorb without starving (us).
+static const int64_t BUFFER_STALL_TOLERANCE = 500000;
+
+// Span of the trailing window loss rates are computed over.
+static const std::chrono::seconds LOSS_WINDOW ( 10 );
+
+// Bounds of the exponential backoff between reconnect attempts.
+static const std::chrono::milliseconds RECONNECT_MIN_BACKOFF ( 250 );
+static const std::chrono::milliseconds RECONNECT_MAX_BACKOFF ( 5000 );
+
+// Number of acquisition state transitions kept for diagnostics.
+static const size_t STATE_HISTORY = 32;
+
+// Longest single wait for a buffer (ms). Bounds how late a stop is noticed
+// when there are no queued buffers to abort, as when the pipeline starves.
+static const int RETRIEVE_SLICE = 50;
+
+i3ds::CosineCamera::CosineCamera(Context::Ptr context, NodeID id, GigECamera::Parameters param, int trigger_scale,
+                                 Options options)
   : GigECamera(context, id, param),
-    trigger_scale_(trigger_scale)
+    trigger_scale_(trigger_scale),
+    options_(options),
+    mConnectionLost(false),
+    writing_(NULL),
+    state_(AcquisitionState::idle),
+    recoveries_(0),
+    last_recovery_time_(0),
+    first_frame_pending_(false),
+    start_latency_(0),
+    stop_latency_(0),
+    timeout_log_(std::chrono::seconds(1)),
+    resize_pending_(false),
+    packed_format_(PackedFormat::none),
+    ring_(options.ring_size),
+    publishing_(false),
+    peak_ring_depth_(0),
+    ring_overflows_(0),
+    starving_(false),
+    starvation_events_(0),
+    stall_period_(0),
+    stall_events_(0),
+    frame_interval_(0),
+    sampling_stats_(false),
+    loss_window_(LOSS_WINDOW),
+    resend_(options.resend_latency),
+    clock_epoch_(0),
+    timing_(),
+    connect_timing_(),
+    start_transient_(false)
 {
   BOOST_LOG_TRIVIAL ( info ) << "CosineCamera::CosineCamera()";
 }
 
 i3ds::CosineCamera::~CosineCamera()
 {
+  control_.stop();
 }
 
 void
@@ -42,39 +98,259 @@ i3ds::CosineCamera::Open()
 {
   BOOST_LOG_TRIVIAL ( info ) << "do_activate()";
 
-  // Connect to the selected Device
-  PvResult lResult = PvResult::Code::INVALID_PARAMETER;
-  mConnectionID = PvString(param_.camera_name.c_str());
-  BOOST_LOG_TRIVIAL ( info ) << "--> ConnectDevice Connection string: " << mConnectionID.GetAscii();
-  device_ = PvDevice::CreateAndConnect ( mConnectionID, &lResult );
+  // Let queued parameter writes finish before the device changes state.
+  control_.flush();
 
-  if ( !lResult.IsOK() )
+  ConnectDevice();
+  SetupDevice();
+
+  if ( !options_.link_group.empty() && !link_.open ( options_.link_group ) )
+    {
+      BOOST_LOG_TRIVIAL ( warning ) << "Unable to open link group " << options_.link_group << ": "
+                                    << strerror ( errno ) << ", not coordinating packet delay";
+    }
+
+  if ( options_.warm_stream && !OpenStream() )
+    {
+      CloseStream();
+      DisconnectDevice();
+      throw i3ds::CommandError ( error_value, "Unable to open stream" );
+    }
+}
+
+static int64_t
+elapsed_us ( std::chrono::steady_clock::time_point since )
+{
+  return std::chrono::duration_cast<std::chrono::microseconds> ( std::chrono::steady_clock::now() - since ).count();
+}
+
+//
+// Locks the device, so that it is not freed while in use. Throws if it is
+// not connected, as while the link is being recovered.
+//
+std::unique_lock<std::recursive_mutex>
+i3ds::CosineCamera::lockDevice ( const char *caller ) const
+{
+  std::unique_lock<std::recursive_mutex> lock ( device_mutex_ );
+
+  if ( device_ == NULL )
+    {
+      throw i3ds::CommandError ( error_state, std::string ( caller ) + ": Camera not connected" );
+    }
+
+  return lock;
+}
+
+bool
+i3ds::CosineCamera::isConnected() const
+{
+  std::lock_guard<std::recursive_mutex> lock ( device_mutex_ );
+  return device_ != NULL;
+}
+
+//
+// Connects to the named camera, directly at its cached address if there
+// is one and by discovery otherwise. Throws if it cannot be reached.
+//
+void
+i3ds::CosineCamera::ConnectDevice()
+{
+  const auto started = std::chrono::steady_clock::now();
+  const AddressCache cache ( options_.address_cache, param_.camera_name );
+
+  ConnectTiming timing = ConnectTiming();
+  std::string ip, mac;
+
+  // Connected without the device lock, so that parameter access fails at
+  // once rather than wait for discovery.
+  PvDevice *lDevice = NULL;
+
+  if ( cache.load ( ip, mac ) )
     {
-      BOOST_LOG_TRIVIAL ( error ) << "CreateAndConnect problem: " << lResult.GetCodeString().GetAscii();
-      throw i3ds::CommandError ( error_value, std::string("Connection problem(probably connection string): ") +
-				 mConnectionID.GetAscii() +
-				 std::string(", error code: ") +
-				 lResult.GetCodeString().GetAscii() );
+      lDevice = ConnectCached ( ip, mac, timing );
+
+      if ( lDevice == NULL )
+        {
+          cache.clear();
+        }
+    }
+
+  if ( lDevice == NULL )
+    {
+      // Connect to the selected Device
+      const auto discovery = std::chrono::steady_clock::now();
+      PvResult lResult = PvResult::Code::INVALID_PARAMETER;
+      mConnectionID = PvString(param_.camera_name.c_str());
+      BOOST_LOG_TRIVIAL ( info ) << "--> ConnectDevice Connection string: " << mConnectionID.GetAscii();
+      lDevice = PvDevice::CreateAndConnect ( mConnectionID, &lResult );
+
+      timing.discovery = elapsed_us ( discovery );
+
+      if ( !lResult.IsOK() )
+        {
+          BOOST_LOG_TRIVIAL ( error ) << "CreateAndConnect problem: " << lResult.GetCodeString().GetAscii();
+          throw i3ds::CommandError ( error_value, std::string("Connection problem(probably connection string): ") +
+				     mConnectionID.GetAscii() +
+				     std::string(", error code: ") +
+				     lResult.GetCodeString().GetAscii() );
+        }
+
+      BOOST_LOG_TRIVIAL ( info ) << "Discovered camera in " << timing.discovery / 1000 << " ms";
     }
 
   // Register this class as an event sink for PvDevice call-backs
-  device_->RegisterEventSink ( this );
+  lDevice->RegisterEventSink ( this );
 
   // Clear connection lost flag as we are now connected to the device
   mConnectionLost = false;
   BOOST_LOG_TRIVIAL ( info ) << "Connected to Camera";
 
-  PvDeviceGEV *lDeviceGEV = dynamic_cast<PvDeviceGEV *> ( device_ );
+  PvDeviceGEV *lDeviceGEV = dynamic_cast<PvDeviceGEV *> ( lDevice );
 
   fetched_ipaddress = lDeviceGEV->GetIPAddress();
   BOOST_LOG_TRIVIAL ( info ) << "IP ADDRESS got from camera" << fetched_ipaddress.GetAscii();
 
+  if ( !timing.cached && cache.enabled() )
+    {
+      if ( !cache.store ( fetched_ipaddress.GetAscii(), lDeviceGEV->GetMACAddress().GetAscii() ) )
+        {
+          BOOST_LOG_TRIVIAL ( warning ) << "Unable to cache camera address in " << options_.address_cache;
+        }
+    }
+
+  timing.total = elapsed_us ( started );
+
+  {
+    std::lock_guard<std::recursive_mutex> lock ( device_mutex_ );
+    device_ = lDevice;
+  }
+
+  std::lock_guard<std::mutex> lock ( timing_mutex_ );
+  connect_timing_ = timing;
+}
+
+//
+// Whether the camera is named by its IP or MAC address, rather than by
+// its user defined name.
+//
+static bool
+isAddress ( const std::string &name )
+{
+  struct in_addr lAddress;
+
+  if ( inet_pton ( AF_INET, name.c_str(), &lAddress ) == 1 )
+    {
+      return true;
+    }
+
+  if ( name.size() != 17 )
+    {
+      return false;
+    }
+
+  for ( size_t i = 0; i < name.size(); i++ )
+    {
+      const bool separator = i % 3 == 2;
+
+      if ( separator ? ( name[i] != ':' && name[i] != '-' ) : !std::isxdigit ( (unsigned char) name[i] ) )
+        {
+          return false;
+        }
+    }
+
+  return true;
+}
+
+//
+// Connects to a cached address and checks that the camera there is still
+// the named one, by its MAC address, and by its user defined name if that
+// is what it is named by. Returns NULL if it cannot be reached or is
+// another camera.
+//
+PvDevice*
+i3ds::CosineCamera::ConnectCached ( const std::string& ip, const std::string& mac, ConnectTiming& timing )
+{
+  const auto direct = std::chrono::steady_clock::now();
+  PvResult lResult = PvResult::Code::INVALID_PARAMETER;
+
+  BOOST_LOG_TRIVIAL ( info ) << "--> ConnectDevice cached address: " << ip;
+
+  PvDevice *lDevice = PvDevice::CreateAndConnect ( PvString ( ip.c_str() ), &lResult );
+
+  timing.direct = elapsed_us ( direct );
+
+  if ( !lResult.IsOK() || lDevice == NULL )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "Cached address " << ip << " not reachable after " << timing.direct / 1000
+                                 << " ms: " << lResult.GetCodeString().GetAscii() << ", discovering";
+      return NULL;
+    }
+
+  const auto verify = std::chrono::steady_clock::now();
+
+  PvDeviceGEV *lDeviceGEV = dynamic_cast<PvDeviceGEV *> ( lDevice );
+  PvString lName;
+
+  bool match = lDeviceGEV != NULL && mac == lDeviceGEV->GetMACAddress().GetAscii();
+
+  if ( match && !isAddress ( param_.camera_name )
+       && lDevice->GetParameters()->GetStringValue ( "DeviceUserID", lName ).IsOK() )
+    {
+      match = param_.camera_name == lName.GetAscii();
+    }
+
+  timing.verify = elapsed_us ( verify );
+
+  if ( !match )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "Camera at cached address " << ip << " is not " << param_.camera_name
+                                 << ", discovering";
+
+      lDevice->Disconnect();
+      PvDevice::Free ( lDevice );
+
+      return NULL;
+    }
+
+  timing.cached = true;
+
+  BOOST_LOG_TRIVIAL ( info ) << "Connected to cached address in " << timing.direct / 1000 << " ms, verified in "
+                             << timing.verify / 1000 << " ms";
+
+  return lDevice;
+}
+
+//
+// Resolves the parameters of a newly connected camera and sets up the
+// transport and pixel format.
+//
+void
+i3ds::CosineCamera::SetupDevice()
+{
+  const auto started = std::chrono::steady_clock::now();
+
+  // Nothing may use the parameters until they are all resolved.
+  std::unique_lock<std::recursive_mutex> device_lock = lockDevice ( "SetupDevice" );
+
   collectParameters();
+  configureTransport();
 
   if ( param_.image_count > 1)
     {
-      setEnum("SourceSelector", "All", true);
+      setEnum(params_.source_selector, "All", true);
     }
+
+  selectPixelFormat();
+
+  std::lock_guard<std::mutex> lock ( timing_mutex_ );
+
+  connect_timing_.setup = elapsed_us ( started );
+  connect_timing_.total += connect_timing_.setup;
+
+  BOOST_LOG_TRIVIAL ( info ) << "Camera ready in " << connect_timing_.total / 1000 << " ms ("
+                             << ( connect_timing_.cached ? "cached address" : "discovery" ) << " "
+                             << ( connect_timing_.direct + connect_timing_.verify + connect_timing_.discovery ) / 1000
+                             << " ms, setup " << connect_timing_.setup / 1000 << " ms)";
 }
 
 void
@@ -82,7 +358,36 @@ i3ds::CosineCamera::Close()
 {
   BOOST_LOG_TRIVIAL ( info ) << "do_deactivate()";
 
+  control_.flush();
+
+  link_.close();
+
+  // Only open here in warm mode, otherwise closed by Stop().
+  CloseStream();
+  DisconnectDevice();
+}
+
+//
+// Disconnects from the camera and frees the device. The parameter nodes
+// go with it.
+//
+void
+i3ds::CosineCamera::DisconnectDevice()
+{
+  std::lock_guard<std::recursive_mutex> lock ( device_mutex_ );
+
+  if ( device_ == NULL )
+    {
+      return;
+    }
+
+  releaseParameters();
+
+  device_->UnregisterEventSink ( this );
   device_->Disconnect();
+
+  PvDevice::Free ( device_ );
+  device_ = NULL;
 }
 
 void
@@ -90,21 +395,67 @@ i3ds::CosineCamera::Start()
 {
   BOOST_LOG_TRIVIAL ( info ) << "do_start()";
 
-  setEnum ( "AcquisitionMode", "Continuous" );
+  control_.flush();
+
+  // Stopped while recovering from link loss, connect again first.
+  if ( !isConnected() )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "Camera was lost, reconnecting";
+
+      try
+        {
+          ConnectDevice();
+          SetupDevice();
+          replayConfiguration();
+        }
+      catch ( i3ds::CommandError &e )
+        {
+          DisconnectDevice();
+          throw i3ds::CommandError ( error_state, std::string ( "Start: Camera not connected: " ) + e.what() );
+        }
+    }
+
+  start_time_ = std::chrono::steady_clock::now();
+
+  ConfigBatch batch;
+
+  batch.set ( params_.acquisition_mode, "Continuous" );
 
   if (param_.external_trigger)
     {
-      timeout_ = 200;
-      setEnum ( "TriggerMode", "EXT_ONLY" );
+      // The trigger sets the rate, warn if it cannot be kept up with.
+      const std::string error = checkPeriod ( period() );
+
+      if ( !error.empty() )
+        {
+          BOOST_LOG_TRIVIAL ( warning ) << error;
+        }
+
+      batch.set ( params_.trigger_mode, "EXT_ONLY" );
     }
   else
     {
-      timeout_ = (int) (2 * period() / 1000);
-      setEnum ( "TriggerMode", "Interval" );
-      setIntParameter ( "TriggerInterval", to_trigger ( period() ) );
+      const std::string error = checkPeriod ( period() );
+
+      if ( !error.empty() )
+        {
+          throw i3ds::CommandError ( error_value, "Start: " + error );
+        }
+
+      batch.set ( params_.trigger_mode, "Interval" );
+      batch.set ( params_.trigger_interval, to_trigger ( period() ) );
     }
 
-  running_ = true;
+  applyConfiguration ( batch );
+  joinLink();
+
+  // Frame timeout from the configured period until arrivals are seen.
+  stall_period_ = period();
+  stall_.reset ( stall_period_ );
+  timeout_ = stall_.timeout();
+
+  setState ( AcquisitionState::opening, "start requested" );
+
   thread_ = std::thread ( &i3ds::CosineCamera::SamplingLoop, this );
 }
 
@@ -113,30 +464,83 @@ i3ds::CosineCamera::Stop()
 {
   BOOST_LOG_TRIVIAL ( info ) << "do_stop()";
 
-  running_ = false;
+  const auto stopping = std::chrono::steady_clock::now();
+
+  {
+    std::lock_guard<std::mutex> lock ( run_mutex_ );
+
+    recordState ( AcquisitionState::stopping, "stop requested" );
+
+    // Wake the sampling thread at once if it is waiting for a buffer, the
+    // aborted buffers come out of the pipeline.
+    if ( mStream != NULL && mStream->IsOpen() )
+      {
+        mStream->AbortQueuedBuffers();
+      }
+
+    // Or if it is blocked on a full frame ring. The publisher is stopped
+    // below, and the ring reset when it is started again.
+    ring_.Interrupt();
+  }
 
   if ( thread_.joinable() )
     {
       thread_.join();
     }
 
-  TearDown ( true );
+  // The sampling thread should notice the stop within one wait slice.
+  const int64_t joined = elapsed_us ( stopping );
+
+  if ( joined > 2 * RETRIEVE_SLICE * 1000 )
+    {
+      BOOST_LOG_TRIVIAL ( warning ) << "Sampling thread took " << joined / 1000.0 << " ms to stop";
+    }
+
+  // A warm stream stays open unless the camera was lost.
+  if ( options_.warm_stream && !mConnectionLost && isStreamOpen() )
+    {
+      PauseStreaming();
+    }
+  else
+    {
+      TearDown ( true );
+    }
+
+  link_.leave();
+
+  setState ( AcquisitionState::idle, "stopped" );
+
+  stop_latency_ = elapsed_us ( stopping );
+
+  BOOST_LOG_TRIVIAL ( info ) << "Stopped in " << stop_latency_ / 1000.0 << " ms";
+
+  BOOST_LOG_TRIVIAL ( info ) << "Peak frame ring depth: " << peak_ring_depth_
+                             << " overflows: " << ring_overflows_;
+  BOOST_LOG_TRIVIAL ( info ) << "Pipeline starvation events: " << starvation_events_;
 }
 
 bool
 i3ds::CosineCamera::setInternalTrigger(int64_t period_us)
 {
+  const std::string error = checkPeriod ( period_us );
+
+  if ( !error.empty() )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << error;
+      throw i3ds::CommandError ( error_value, "setInternalTrigger: " + error );
+    }
+
   // TODO: Check this computation.
   int64_t trigger = to_trigger(period_us);
 
-  int64_t min = getMinParameter("TriggerInterval");
-  int64_t max = getMaxParameter("TriggerInterval");
+  int64_t min = getMinParameter(params_.trigger_interval);
+  int64_t max = getMaxParameter(params_.trigger_interval);
 
   BOOST_LOG_TRIVIAL ( info ) << "min: " << min << " max: " << max << "trigger: " << trigger;
 
   if (min <= trigger && trigger <= max)
     {
-      setIntParameter("TriggerInterval", trigger);
+      submitWrite("trigger_interval", [this, trigger]() {setIntParameter(params_.trigger_interval, trigger);});
       return true;
     }
   else
@@ -148,87 +552,136 @@ i3ds::CosineCamera::setInternalTrigger(int64_t period_us)
 int64_t
 i3ds::CosineCamera::getSensorWidth() const
 {
-  return getParameter("Width");
+  std::unique_lock<std::recursive_mutex> lock = lockDevice ( "getSensorWidth" );
+
+  if ( params_.sensor_width.node != NULL )
+    {
+      return getParameter(params_.sensor_width);
+    }
+
+  if ( params_.offset_x.node != NULL )
+    {
+      return getMaxParameter(params_.width) + getParameter(params_.offset_x);
+    }
+
+  return getParameter(params_.width);
 }
 
 int64_t
 i3ds::CosineCamera::getSensorHeight() const
 {
-  return getParameter("Height");
+  std::unique_lock<std::recursive_mutex> lock = lockDevice ( "getSensorHeight" );
+
+  if ( params_.sensor_height.node != NULL )
+    {
+      return getParameter(params_.sensor_height);
+    }
+
+  if ( params_.offset_y.node != NULL )
+    {
+      return getMaxParameter(params_.height) + getParameter(params_.offset_y);
+    }
+
+  return getParameter(params_.height);
 }
 
 bool
 i3ds::CosineCamera::isRegionSupported() const
 {
-  return false;
+  std::lock_guard<std::recursive_mutex> lock ( device_mutex_ );
+
+  return params_.width.node != NULL && params_.width.node->IsWritable()
+         && params_.height.node != NULL && params_.height.node->IsWritable()
+         && params_.offset_x.node != NULL && params_.offset_y.node != NULL;
 }
 
 int64_t
 i3ds::CosineCamera::getRegionWidth() const
 {
-  return getSensorWidth();
+  return getParameter(params_.width);
 }
 
 int64_t
 i3ds::CosineCamera::getRegionHeight() const
 {
-  return getSensorHeight();
+  return getParameter(params_.height);
 }
 
 int64_t
 i3ds::CosineCamera::getRegionOffsetX() const
 {
-  return 0;
+  std::unique_lock<std::recursive_mutex> lock = lockDevice ( "getRegionOffsetX" );
+
+  return params_.offset_x.node != NULL ? getParameter(params_.offset_x) : 0;
 }
 
 int64_t
 i3ds::CosineCamera::getRegionOffsetY() const
 {
-  return 0;
+  std::unique_lock<std::recursive_mutex> lock = lockDevice ( "getRegionOffsetY" );
+
+  return params_.offset_y.node != NULL ? getParameter(params_.offset_y) : 0;
 }
 
 void
 i3ds::CosineCamera::setRegionWidth(int64_t width)
 {
+  submitWrite("region_width", [this, width]()
+  {
+    updateRegion(width, getRegionHeight(), getRegionOffsetX(), getRegionOffsetY());
+  });
 }
 
 void
 i3ds::CosineCamera::setRegionHeight(int64_t height)
 {
+  submitWrite("region_height", [this, height]()
+  {
+    updateRegion(getRegionWidth(), height, getRegionOffsetX(), getRegionOffsetY());
+  });
 }
 
 void
 i3ds::CosineCamera::setRegionOffsetX(int64_t offset_x)
 {
+  submitWrite("region_offset_x", [this, offset_x]()
+  {
+    updateRegion(getRegionWidth(), getRegionHeight(), offset_x, getRegionOffsetY());
+  });
 }
 
 void
 i3ds::CosineCamera::setRegionOffsetY(int64_t offset_y)
 {
+  submitWrite("region_offset_y", [this, offset_y]()
+  {
+    updateRegion(getRegionWidth(), getRegionHeight(), getRegionOffsetX(), offset_y);
+  });
 }
 
 int64_t
 i3ds::CosineCamera::getShutter() const
 {
-  return getParameter("ShutterTimeValue");
+  // The camera changes the shutter time by itself in auto mode.
+  return getParameter(params_.shutter_time, !getAutoShutterEnabled());
 }
 
 int64_t
 i3ds::CosineCamera::getMaxShutter() const
 {
-  return getMaxParameter("MaxShutterTimeValue");
+  return getMaxParameter(params_.max_shutter_time);
 }
 
 int64_t
 i3ds::CosineCamera::getMinShutter() const
 {
-  return getMinParameter("MaxShutterTimeValue");
+  return getMinParameter(params_.max_shutter_time);
 }
 
 void
 i3ds::CosineCamera::setShutter(int64_t shutter_us)
 {
-  setIntParameter("ShutterTimeValue", shutter_us);
+  submitWrite("shutter", [this, shutter_us]() {setIntParameter(params_.shutter_time, shutter_us);});
 }
 
 bool
@@ -240,52 +693,52 @@ i3ds::CosineCamera::isAutoShutterSupported() const
 bool
 i3ds::CosineCamera::getAutoShutterEnabled() const
 {
-  return getEnum("AutoExposure") == "ON" && getBooleanParameter("AutoShutterTime");
+  return getEnum(params_.auto_exposure) == "ON" && getBooleanParameter(params_.auto_shutter_time);
 }
 
 void
 i3ds::CosineCamera::setAutoShutterEnabled(bool enable)
 {
-  if (enable)
-    {
-      setEnum("AutoExposure", "ON");
-      setBooleanParameter("AutoShutterTime", true);
-    }
-  else
-    {
-      setBooleanParameter("AutoShutterTime", false);
-      setEnum("AutoExposure", "OFF");
-    }
+  submitWrite("auto_shutter", [this, enable]()
+  {
+    ConfigBatch batch;
+
+    batch.set(params_.auto_exposure, enable ? "ON" : "OFF");
+    batch.set(params_.auto_shutter_time, enable);
+
+    applyConfiguration(batch);
+  });
 }
 
 int64_t
 i3ds::CosineCamera::getAutoShutterLimit() const
 {
-  return getParameter("MaxShutterTimeValue");
+  return getParameter(params_.max_shutter_time);
 }
 
 int64_t
 i3ds::CosineCamera::getMaxAutoShutterLimit() const
 {
-  return getMaxParameter("MaxShutterTimeValue");
+  return getMaxParameter(params_.max_shutter_time);
 }
 
 int64_t
 i3ds::CosineCamera::getMinAutoShutterLimit() const
 {
-  return getMinParameter("MaxShutterTimeValue");
+  return getMinParameter(params_.max_shutter_time);
 }
 
 void
 i3ds::CosineCamera::setAutoShutterLimit(int64_t shutter_limit)
 {
-  setIntParameter("MaxShutterTimeValue", shutter_limit);
+  submitWrite("auto_shutter_limit", [this, shutter_limit]() {setIntParameter(params_.max_shutter_time, shutter_limit);});
 }
 
 double
 i3ds::CosineCamera::getGain() const
 {
-  return raw_to_gain(getParameter("GainValue"));
+  // The camera changes the gain by itself in auto mode.
+  return raw_to_gain(getParameter(params_.gain, !getAutoGainEnabled()));
 }
 
 double
@@ -304,7 +757,7 @@ i3ds::CosineCamera::getMinGain() const
 void
 i3ds::CosineCamera::setGain(double gain)
 {
-  setIntParameter("GainValue", gain_to_raw(gain));
+  submitWrite("gain", [this, gain]() {setIntParameter(params_.gain, gain_to_raw(gain));});
 }
 
 bool
@@ -316,23 +769,21 @@ i3ds::CosineCamera::isAutoGainSupported() const
 bool
 i3ds::CosineCamera::getAutoGainEnabled() const
 {
-  return getEnum("AutoExposure") == "ON" && getBooleanParameter("AutoGain");
+  return getEnum(params_.auto_exposure) == "ON" && getBooleanParameter(params_.auto_gain);
 }
 
 void
 i3ds::CosineCamera::setAutoGainEnabled(bool enable)
 {
-  if (enable)
-    {
-      setEnum("AutoExposure", "ON");
-      setBooleanParameter("AutoGain", true);
+  submitWrite("auto_gain", [this, enable]()
+  {
+    ConfigBatch batch;
 
-    }
-  else
-    {
-      setBooleanParameter("AutoGain", false);
-      setEnum("AutoExposure", "OFF");
-    }
+    batch.set(params_.auto_exposure, enable ? "ON" : "OFF");
+    batch.set(params_.auto_gain, enable);
+
+    applyConfiguration(batch);
+  });
 }
 
 double
@@ -373,691 +824,2630 @@ i3ds::CosineCamera::gain_to_raw(double gain) const
   return (int64_t) gain;
 }
 
-int64_t
-i3ds::CosineCamera::to_trigger(int64_t period)
+//
+// Selects a packed 12-bit pixel format if the camera has one, so that the
+// link carries 25% less data. Frames are unpacked on the host.
+//
+void
+i3ds::CosineCamera::selectPixelFormat()
 {
-  return (period * trigger_scale_) / 1000000;
+  packed_format_ = PackedFormat::none;
+
+  if ( param_.data_depth != 12 || !options_.packed_pixels || params_.pixel_format.node == NULL )
+    {
+      return;
+    }
+
+  if ( isEnumOption ( params_.pixel_format, "Mono12Packed" ) )
+    {
+      setEnum ( params_.pixel_format, "Mono12Packed", true );
+      packed_format_ = PackedFormat::mono12packed;
+    }
+  else if ( isEnumOption ( params_.pixel_format, "Mono12p" ) )
+    {
+      setEnum ( params_.pixel_format, "Mono12p", true );
+      packed_format_ = PackedFormat::mono12p;
+    }
+  else
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "Camera has no packed 12-bit pixel format";
+      return;
+    }
+
+  BOOST_LOG_TRIVIAL ( info ) << "Using packed pixel format: " << getEnum ( params_.pixel_format )
+                             << ", unpacked with " << pixel_kernels().name << " kernels";
 }
 
+//
+// Rounds the value down to the increment of the parameter, but not below
+// its minimum.
+//
 int64_t
-i3ds::CosineCamera::to_period(int64_t trigger)
+i3ds::CosineCamera::alignDown(const IntParameter& parameter, int64_t value) const
 {
-  return (trigger * 1000000) / trigger_scale_;
+  const IntRange range = getRange(parameter);
+
+  if (value <= range.min)
+    {
+      return range.min;
+    }
+
+  return value - (value - range.min) % range.increment;
 }
 
+//
+// Writes a new region of interest. Sizes and offsets are aligned to the
+// increments of the device, and offsets are pulled in so that the region
+// stays on the sensor. On each axis the write that shrinks the region goes
+// first, so that every intermediate region is valid.
+//
 void
-i3ds::CosineCamera::OnLinkDisconnected ( PvDevice *aDevice )
+i3ds::CosineCamera::updateRegion(int64_t width, int64_t height, int64_t offset_x, int64_t offset_y)
 {
-  BOOST_LOG_TRIVIAL ( info )
-      << "=====> PvDeviceEventSink::OnLinkDisconnected callback";
+  if (!isRegionSupported())
+    {
+      throw i3ds::CommandError(error_unsupported, "Region of interest not supported");
+    }
 
-  mConnectionLost = true;
+  const int64_t sensor_width = getSensorWidth();
+  const int64_t sensor_height = getSensorHeight();
 
-  // IMPORTANT:
-  // The PvDevice MUST NOT be explicitly disconnected from this callback.
-  // Here we just raise a flag that we lost the device and let the main loop
-  // of the application (from the main application thread) perform the
-  // disconnect.
-  //
+  width = alignDown(params_.width, std::min(width, sensor_width));
+  height = alignDown(params_.height, std::min(height, sensor_height));
+  offset_x = alignDown(params_.offset_x, std::min(offset_x, sensor_width - width));
+  offset_y = alignDown(params_.offset_y, std::min(offset_y, sensor_height - height));
 
-}
+  BOOST_LOG_TRIVIAL ( info ) << "Region: " << width << "x" << height << "+" << offset_x << "+" << offset_y;
 
-void
-i3ds::CosineCamera::collectParameters()
-{
-  BOOST_LOG_TRIVIAL ( info ) << "Collecting Camera parameters";
-  lParameters = device_->GetParameters();
+  if (offset_x < getRegionOffsetX())
+    {
+      setIntParameter(params_.offset_x, offset_x);
+      setIntParameter(params_.width, width);
+    }
+  else
+    {
+      setIntParameter(params_.width, width);
+      setIntParameter(params_.offset_x, offset_x);
+    }
+
+  if (offset_y < getRegionOffsetY())
+    {
+      setIntParameter(params_.offset_y, offset_y);
+      setIntParameter(params_.height, height);
+    }
+  else
+    {
+      setIntParameter(params_.height, height);
+      setIntParameter(params_.offset_y, offset_y);
+    }
+
+  // The pipeline belongs to the sampling thread, which resizes it before
+  // the next retrieval or start.
+  resize_pending_ = true;
 }
 
-int64_t
-i3ds::CosineCamera::getParameter ( PvString whichParameter ) const
+//
+// Follows a change of payload size with the pipeline buffers. Called by
+// the sampling thread, or with it stopped.
+//
+void
+i3ds::CosineCamera::resizeBuffers()
 {
+  int64_t lSize = 0;
+
+  {
+    std::lock_guard<std::recursive_mutex> lock ( device_mutex_ );
+
+    if ( mPipeline == NULL || device_ == NULL )
+      {
+        return;
+      }
 
-  BOOST_LOG_TRIVIAL ( info ) << "Fetching parameter: "
-                             << whichParameter.GetAscii();
-  PvGenParameter *lParameter = lParameters->Get ( whichParameter );
-  PvGenInteger *lIntParameter = dynamic_cast<PvGenInteger *> ( lParameter );
+    lSize = device_->GetPayloadSize();
+  }
 
-  if ( lIntParameter == NULL )
+  if ( lSize == mPipeline->GetBufferSize() )
     {
-      ostringstream errorDescription;
+      return;
+    }
 
-      BOOST_LOG_TRIVIAL ( info ) << "Unable to get the parameter: "
-                                 << whichParameter.GetAscii();
+  BOOST_LOG_TRIVIAL ( info ) << "Payload size changed from " << mPipeline->GetBufferSize()
+                             << " to " << lSize << ", resizing pipeline buffers";
 
-      errorDescription << "getParameter: Unable to get the parameter: " << whichParameter.GetAscii();
+  // Buffers are reallocated by the pipeline as they are returned to it.
+  mPipeline->SetBufferSize ( static_cast<uint32_t> ( lSize ) );
+  mPipeline->SetBufferCount ( bufferCount ( lSize ) );
+}
 
-      throw i3ds::CommandError ( error_value, errorDescription.str() );
-    }
+int64_t
+i3ds::CosineCamera::to_trigger(int64_t period)
+{
+  return (period * trigger_scale_) / 1000000;
+}
 
-  // Read current width value.
-  int64_t lParameterValue = 0;
+int64_t
+i3ds::CosineCamera::to_period(int64_t trigger)
+{
+  return (trigger * 1000000) / trigger_scale_;
+}
 
-  if ( ! ( lIntParameter->GetValue ( lParameterValue ).IsOK() ) )
-    {
-      ostringstream errorDescription;
+void
+i3ds::CosineCamera::OnLinkDisconnected ( PvDevice *aDevice )
+{
+  BOOST_LOG_TRIVIAL ( info )
+      << "=====> PvDeviceEventSink::OnLinkDisconnected callback";
 
-      BOOST_LOG_TRIVIAL ( info ) << "Error retrieving parameter from device";
+  {
+    std::lock_guard<std::mutex> lock ( run_mutex_ );
 
-      errorDescription << "getParameter: Error retrieving parameter from device" << whichParameter.GetAscii();
+    mConnectionLost = true;
 
-      throw i3ds::CommandError ( error_value, errorDescription.str() );
-    }
+    // Wake the sampling thread if it is waiting for a buffer.
+    if ( mStream != NULL && mStream->IsOpen() )
+      {
+        mStream->AbortQueuedBuffers();
+      }
+  }
+
+  run_cond_.notify_all();
+
+  // IMPORTANT:
+  // The PvDevice MUST NOT be explicitly disconnected from this callback.
+  // Here we just raise a flag that we lost the device and let the main loop
+  // of the application (from the main application thread) perform the
+  // disconnect.
+  //
 
-  BOOST_LOG_TRIVIAL ( info ) << "Parametervalue: " << lParameterValue
-                             << " returned from parameter: " << whichParameter.GetAscii();
-  return lParameterValue;
 }
 
-// Fetching minimum allowed value of parameter
-int64_t
-i3ds::CosineCamera::getMinParameter ( PvString whichParameter ) const
+i3ds::CosineCamera::DeviceParameters::DeviceParameters()
+  : sensor_width("SensorWidth"),
+    sensor_height("SensorHeight"),
+    width("Width"),
+    height("Height"),
+    offset_x("OffsetX"),
+    offset_y("OffsetY"),
+    shutter_time("ShutterTimeValue"),
+    max_shutter_time("MaxShutterTimeValue"),
+    gain("GainValue"),
+    trigger_interval("TriggerInterval"),
+    acquisition_mode("AcquisitionMode"),
+    trigger_mode("TriggerMode"),
+    auto_exposure("AutoExposure"),
+    source_selector("SourceSelector"),
+    pixel_format("PixelFormat"),
+    auto_shutter_time("AutoShutterTime"),
+    auto_gain("AutoGain"),
+    acquisition_start("AcquisitionStart"),
+    acquisition_stop("AcquisitionStop"),
+    packet_size("GevSCPSPacketSize"),
+    packet_delay("GevSCPD"),
+    link_speed("GevLinkSpeed"),
+    timestamp_tick_frequency("GevTimestampTickFrequency"),
+    timestamp_value("GevTimestampValue"),
+    timestamp_latch("GevTimestampControlLatch")
 {
+  integers = {&sensor_width, &sensor_height, &width, &height, &offset_x, &offset_y,
+              &shutter_time, &max_shutter_time, &gain, &trigger_interval,
+              &packet_size, &packet_delay, &link_speed, &timestamp_tick_frequency, &timestamp_value
+             };
+  enums = {&acquisition_mode, &trigger_mode, &auto_exposure, &source_selector, &pixel_format};
+
+  all = {&sensor_width, &sensor_height, &width, &height, &offset_x, &offset_y, &shutter_time, &max_shutter_time, &gain, &trigger_interval,
+         &acquisition_mode, &trigger_mode, &auto_exposure, &source_selector, &pixel_format,
+         &auto_shutter_time, &auto_gain, &acquisition_start, &acquisition_stop,
+         &packet_size, &packet_delay, &link_speed, &timestamp_tick_frequency, &timestamp_value, &timestamp_latch
+        };
+}
 
-  PvGenParameter *lParameter = lParameters->Get ( whichParameter );
-
-  // Converter generic parameter to width using dynamic cast. If the
-  // type is right, the conversion will work otherwise lWidth will be NULL.
-  PvGenInteger *lMinParameter = dynamic_cast<PvGenInteger *> ( lParameter );
+//
+// Resolves a parameter to its typed node, NULL if the device lacks it.
+//
+template<typename T>
+static void
+resolveParameter ( PvGenParameterArray *parameters, i3ds::CosineCamera::Parameter<T> &parameter )
+{
+  parameter.node = dynamic_cast<T *> ( parameters->Get ( parameter.name ) );
+  parameter.generic = parameter.node;
+  parameter.changes++;
 
-  if ( lMinParameter == NULL )
+  if ( parameter.node == NULL )
     {
-      BOOST_LOG_TRIVIAL ( info ) << "Unable to get the Minimum parameter for: "
-                                 << whichParameter.GetAscii();
+      BOOST_LOG_TRIVIAL ( warning ) << "Camera does not have parameter: " << parameter.name;
     }
+}
 
-  int64_t lMinValue = 0;
-
-  if ( ! ( lMinParameter->GetMin ( lMinValue ).IsOK() ) )
-    {
-      BOOST_LOG_TRIVIAL ( info ) << "Error retrieving minimum value from device";
-    }
-  else
+//
+// Throws if the parameter was not found on the device.
+//
+template<typename T>
+static T *
+checkParameter ( const i3ds::CosineCamera::Parameter<T> &parameter, const char *caller )
+{
+  if ( parameter.node == NULL )
     {
-      BOOST_LOG_TRIVIAL ( info ) << "Minimum value for parameter: "
-                                 << whichParameter.GetAscii() << " : " << lMinValue;
+      BOOST_LOG_TRIVIAL ( info ) << "Unable to get the parameter: " << parameter.name;
+
+      ostringstream errorDescription;
+      errorDescription << caller << ": Unable to get the parameter: " << parameter.name;
+
+      throw i3ds::CommandError ( error_value, errorDescription.str() );
     }
 
-  return lMinValue;
+  return parameter.node;
 }
 
-// Get maximum allowed value of parameter.
-int64_t
-i3ds::CosineCamera::getMaxParameter ( PvString whichParameter ) const
+//
+// Looks up every parameter the driver uses once, so that getters and
+// setters need no string lookups or casts afterwards.
+//
+void
+i3ds::CosineCamera::collectParameters()
 {
+  BOOST_LOG_TRIVIAL ( info ) << "Collecting Camera parameters";
+  lParameters = device_->GetParameters();
 
-  PvGenParameter *lParameter = lParameters->Get ( whichParameter );
-
-  // Converter generic parameter to width using dynamic cast. If the
-  // type is right, the conversion will work otherwise lWidth will be NULL.
-  PvGenInteger *lMaxParameter = dynamic_cast<PvGenInteger *> ( lParameter );
-
-  if ( lMaxParameter == NULL )
+  resolveParameter ( lParameters, params_.sensor_width );
+  resolveParameter ( lParameters, params_.sensor_height );
+  resolveParameter ( lParameters, params_.width );
+  resolveParameter ( lParameters, params_.height );
+  resolveParameter ( lParameters, params_.offset_x );
+  resolveParameter ( lParameters, params_.offset_y );
+  resolveParameter ( lParameters, params_.shutter_time );
+  resolveParameter ( lParameters, params_.max_shutter_time );
+  resolveParameter ( lParameters, params_.gain );
+  resolveParameter ( lParameters, params_.trigger_interval );
+  resolveParameter ( lParameters, params_.acquisition_mode );
+  resolveParameter ( lParameters, params_.trigger_mode );
+  resolveParameter ( lParameters, params_.auto_exposure );
+  resolveParameter ( lParameters, params_.source_selector );
+  resolveParameter ( lParameters, params_.pixel_format );
+  resolveParameter ( lParameters, params_.auto_shutter_time );
+  resolveParameter ( lParameters, params_.auto_gain );
+  resolveParameter ( lParameters, params_.acquisition_start );
+  resolveParameter ( lParameters, params_.acquisition_stop );
+  resolveParameter ( lParameters, params_.packet_size );
+  resolveParameter ( lParameters, params_.packet_delay );
+  resolveParameter ( lParameters, params_.link_speed );
+  resolveParameter ( lParameters, params_.timestamp_tick_frequency );
+  resolveParameter ( lParameters, params_.timestamp_value );
+  resolveParameter ( lParameters, params_.timestamp_latch );
+
+  // Be told when the device configuration changes what we have cached.
+  for ( ParameterBase *p : params_.all )
     {
-      BOOST_LOG_TRIVIAL ( info ) << "Unable to get parameter "
-                                 << whichParameter.GetAscii();
+      if ( p->generic != NULL )
+        {
+          p->generic->RegisterEventSink ( this );
+        }
     }
 
-  int64_t lMaxAllowedValue = 0;
-  if ( ! ( lMaxParameter->GetMax ( lMaxAllowedValue ).IsOK() ) )
+  // Take the capability snapshot, so that validation and range queries
+  // are answered from memory.
+  for ( IntParameter *p : params_.integers )
     {
-      BOOST_LOG_TRIVIAL ( info )
-          << "Error retrieving max value from device for parameter "
-          << whichParameter.GetAscii();
-      return 0;
+      if ( p->node != NULL )
+        {
+          getRange ( *p );
+        }
     }
-  else
+
+  for ( EnumParameter *p : params_.enums )
     {
-      BOOST_LOG_TRIVIAL ( info ) << "Max allowed value for parameter: "
-                                 << whichParameter.GetAscii() << " is " << lMaxAllowedValue;
-      return lMaxAllowedValue;
+      if ( p->node != NULL )
+        {
+          getEnumOptions ( *p );
+        }
     }
 
+  resetClock();
 }
 
-std::string
-i3ds::CosineCamera::getEnum ( PvString whichParameter ) const
+//
+// Forgets the nodes of a device about to be freed, and everything cached
+// from them.
+//
+void
+i3ds::CosineCamera::releaseParameters()
 {
-  PvGenParameter *lGenParameter = lParameters->Get ( whichParameter );
-
-  // Parameter available?
-  if ( !lGenParameter->IsAvailable() )
+  for ( ParameterBase *p : params_.all )
     {
-      BOOST_LOG_TRIVIAL ( info ) << "{Not Available}";
-      throw i3ds::CommandError ( error_value, "eBUS: Enum not available" );
-    }
+      if ( p->generic != NULL )
+        {
+          p->generic->UnregisterEventSink ( this );
+        }
 
-  // Parameter readable?
-  if ( !lGenParameter->IsReadable() )
-    {
-      BOOST_LOG_TRIVIAL ( info ) << "{Not readable}";
-      throw i3ds::CommandError ( error_value, "eBUS: Enum not readable" );
+      p->release();
+      p->changes++;
     }
+}
 
-  // Get the parameter type
-  PvGenType lType;
-  lGenParameter->GetType ( lType );
+//
+// GenICam change callback, also raised for parameters whose range depends
+// on a changed one. Invalidates what is cached about the parameter.
+//
+void
+i3ds::CosineCamera::OnParameterUpdate ( PvGenParameter *aParameter )
+{
+  // Raised on the thread that touched the parameter, which holds the device
+  // already, so this does not wait.
+  std::lock_guard<std::recursive_mutex> lock ( device_mutex_ );
 
-  if ( lType != PvGenTypeEnum )
+  if ( aParameter == writing_ )
     {
-      BOOST_LOG_TRIVIAL ( info ) << "Not an enum";
-      throw i3ds::CommandError ( error_value, "eBUS: Not an enum" );
+      return;
     }
 
-  PvString lValue;
+  for ( ParameterBase *p : params_.all )
+    {
+      if ( p->generic == aParameter )
+        {
+          p->changes++;
+          return;
+        }
+    }
+}
 
-  static_cast<PvGenEnum *> ( lGenParameter )->GetValue ( lValue );
+//
+// Range of the parameter, read from the device only if it changed since
+// it was last read.
+//
+i3ds::CosineCamera::IntRange
+i3ds::CosineCamera::getRange ( const IntParameter &parameter ) const
+{
+  std::unique_lock<std::mutex> lock ( cache_mutex_ );
 
-  BOOST_LOG_TRIVIAL ( info ) << "Enum: " << lValue.GetAscii();
+  const uint64_t changes = parameter.changes;
 
-  return std::string ( lValue.GetAscii() );
-}
+  if ( parameter.range_changes == changes )
+    {
+      return parameter.range;
+    }
 
-bool
-i3ds::CosineCamera::checkIfEnumOptionIsOK ( PvString whichParameter,
-    PvString value ) const
-{
-  BOOST_LOG_TRIVIAL ( info ) << "checkIfEnumOptionIsOK: Parameter: "
-                             << whichParameter.GetAscii() << "Value: " << value.GetAscii();
+  lock.unlock();
 
-  //To pull out enums options
+  std::unique_lock<std::recursive_mutex> device_lock = lockDevice ( "getRange" );
+  PvGenInteger *lParameter = checkParameter ( parameter, "getRange" );
 
-  int64_t aCount;
+  IntRange range = {0, 0, 1};
 
-  auto *lGenParameter = lParameters->Get ( whichParameter );
-  static_cast<PvGenEnum *> ( lGenParameter )->GetEntriesCount ( aCount );
-  BOOST_LOG_TRIVIAL ( info ) << "Enum entries: " << aCount;
+  if ( ! ( lParameter->GetMin ( range.min ).IsOK() ) )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "Error retrieving minimum value from device";
+    }
 
-  for ( int i = 0; i < aCount; i++ )
+  if ( ! ( lParameter->GetMax ( range.max ).IsOK() ) )
     {
-      const PvGenEnumEntry *aEntry;
+      BOOST_LOG_TRIVIAL ( info ) << "Error retrieving max value from device for parameter "
+                                 << parameter.name;
+    }
 
-      static_cast<PvGenEnum *> ( lGenParameter )->GetEntryByIndex ( i, &aEntry );
-      PvString enumOption;
-      aEntry->GetName ( enumOption );
-      BOOST_LOG_TRIVIAL ( info ) << "EnumText[" << i << "]: "
-                                 << enumOption.GetAscii();
-      if ( enumOption == value )
-        {
-          BOOST_LOG_TRIVIAL ( info ) << "Option found.";
-          return true;
-        }
+  if ( ! ( lParameter->GetIncrement ( range.increment ).IsOK() ) || range.increment < 1 )
+    {
+      range.increment = 1;
     }
 
-  BOOST_LOG_TRIVIAL ( info ) << "Option not found.";
+  BOOST_LOG_TRIVIAL ( info ) << "Range of parameter: " << parameter.name << " is [" << range.min
+                             << ", " << range.max << "] step " << range.increment;
 
-  ostringstream errorDescription;
+  lock.lock();
 
-  errorDescription << "checkEnum: Option: " << value.GetAscii() << " does not exists for parameter: "
-                   << whichParameter.GetAscii();
+  // Keep it only if nothing changed while reading.
+  if ( parameter.changes == changes )
+    {
+      parameter.range = range;
+      parameter.range_changes = changes;
+    }
 
-  throw i3ds::CommandError ( error_value, errorDescription.str() );
+  return range;
 }
 
-
-void
-i3ds::CosineCamera::setEnum ( PvString whichParameter, PvString value, bool dontCheckParameter )
+//
+// Options of the enum, read from the device only if it changed since they
+// were last read.
+//
+std::vector<std::string>
+i3ds::CosineCamera::getEnumOptions ( const EnumParameter &parameter ) const
 {
-  BOOST_LOG_TRIVIAL ( info ) << "setEnum: Parameter: "
-                             << whichParameter.GetAscii() << " Value: " << value.GetAscii();
-  BOOST_LOG_TRIVIAL ( info ) << "do checkIfEnumOptionIsOK: Parameter first";
+  std::unique_lock<std::mutex> lock ( cache_mutex_ );
 
-  bool enumOK = true;
+  const uint64_t changes = parameter.changes;
 
-  if ( dontCheckParameter == false )
+  if ( parameter.options_changes == changes )
     {
-      enumOK = checkIfEnumOptionIsOK ( whichParameter, value );
+      return parameter.options;
     }
 
-  // enumOK== true if not options not checked.
-  if ( enumOK )
-    {
+  lock.unlock();
 
-      PvGenParameter *lParameter = lParameters->Get ( whichParameter );
-      auto *lEnumParameter = dynamic_cast<PvGenEnum *> ( lParameter );
+  std::unique_lock<std::recursive_mutex> device_lock = lockDevice ( "getEnumOptions" );
+  PvGenEnum *lGenParameter = checkParameter ( parameter, "getEnumOptions" );
 
-      if ( lEnumParameter == NULL )
-        {
-          BOOST_LOG_TRIVIAL ( info ) << "Unable to get the parameter: " << whichParameter.GetAscii();
-          ostringstream errorDescription;
-          errorDescription << "setEnum: Unable to get parameter: " << whichParameter.GetAscii();
+  int64_t aCount = 0;
+  lGenParameter->GetEntriesCount ( aCount );
 
-          throw i3ds::CommandError ( error_value, errorDescription.str() );
-        }
+  std::vector<std::string> options;
 
-      if ( ! ( lEnumParameter->SetValue ( value ).IsOK() ) )
-        {
-          BOOST_LOG_TRIVIAL ( info ) << "Error setting parameter for device";
-          ostringstream errorDescription;
-          errorDescription << "setEnum: Error setting value: " << value.GetAscii() <<
-                           " for parameter: " << whichParameter.GetAscii();
+  for ( int i = 0; i < aCount; i++ )
+    {
+      const PvGenEnumEntry *aEntry;
 
-          throw i3ds::CommandError ( error_value, errorDescription.str() );
-        }
-      else
+      if ( lGenParameter->GetEntryByIndex ( i, &aEntry ).IsOK() && aEntry->IsAvailable() )
         {
-          BOOST_LOG_TRIVIAL ( info ) << "Parameter value: " << value.GetAscii()
-                                     << " set for parameter: " << whichParameter.GetAscii();
-          return;
+          PvString enumOption;
+          aEntry->GetName ( enumOption );
+          options.push_back ( enumOption.GetAscii() );
         }
-
     }
-  else
+
+  BOOST_LOG_TRIVIAL ( info ) << "Enum: " << parameter.name << " has " << options.size() << " options";
+
+  lock.lock();
+
+  if ( parameter.changes == changes )
     {
-      BOOST_LOG_TRIVIAL ( info ) << "Illegal parameter value";
-      ostringstream errorDescription;
-      errorDescription << "setEnum: Illegal parameter value: " << value.GetAscii() <<
-                       " for parameter: " << whichParameter.GetAscii();
-      throw i3ds::CommandError ( error_value, errorDescription.str() );
+      parameter.options = options;
+      parameter.options_changes = changes;
     }
+
+  return options;
 }
 
+//
+// Looks up the cached value of the parameter. On a miss, changes is set to
+// the count to pass to setCachedValue after reading the device.
+//
+template<typename P, typename V>
 bool
-i3ds::CosineCamera::getBooleanParameter ( PvString whichParameter ) const
+i3ds::CosineCamera::getCachedValue ( const P &parameter, V &value, uint64_t &changes ) const
 {
-  PvGenParameter *lParameter = lParameters->Get ( whichParameter );
+  std::lock_guard<std::mutex> lock ( cache_mutex_ );
 
-  bool lValue;
-  static_cast<PvGenBoolean *> ( lParameter )->GetValue ( lValue );
+  changes = parameter.changes;
 
-  if ( lValue )
+  if ( parameter.value_changes == changes )
     {
-      BOOST_LOG_TRIVIAL ( info ) << whichParameter.GetAscii() << "Boolean: TRUE";
+      value = parameter.value;
       return true;
     }
-  else
+
+  return false;
+}
+
+//
+// Stores a value read from or written to the device, unless the parameter
+// changed after the given count was taken.
+//
+template<typename P, typename V>
+void
+i3ds::CosineCamera::setCachedValue ( const P &parameter, const V &value, uint64_t changes ) const
+{
+  std::lock_guard<std::mutex> lock ( cache_mutex_ );
+
+  if ( parameter.changes == changes )
     {
-      BOOST_LOG_TRIVIAL ( info ) << whichParameter.GetAscii()
-                                 << "Boolean: FALSE";
-      return true;
+      parameter.value = value;
+      parameter.value_changes = changes;
     }
 }
 
+//
+// Records the value written to a parameter, to be replayed if the camera
+// has to be reconnected.
+//
+template<typename P, typename V>
 void
-i3ds::CosineCamera::setBooleanParameter ( PvString whichParameter, bool status )
+i3ds::CosineCamera::rememberWrite ( const P &parameter, const V &value )
 {
-  PvGenParameter *lParameter = lParameters->Get ( whichParameter );
+  ConfigBatch batch;
+  batch.set ( parameter, value );
 
-  PvResult result = static_cast<PvGenBoolean *> ( lParameter )->SetValue ( status );
+  std::lock_guard<std::mutex> lock ( written_mutex_ );
+  written_[&parameter] = batch.changes_.front();
+}
 
-  if ( result != PvResult::Code::OK )
-    {
-      BOOST_LOG_TRIVIAL ( info ) << "Error setting boolean parameter: " << whichParameter.GetAscii() << " to " << status;
+//
+// Writes everything written before back to a reconnected camera, in
+// dependency order.
+//
+void
+i3ds::CosineCamera::replayConfiguration()
+{
+  ConfigBatch batch;
 
-      ostringstream errorDescription;
+  {
+    std::lock_guard<std::mutex> lock ( written_mutex_ );
 
-      errorDescription << "setBooleanParameter Option: Unable to set the parameter: "
-                       << whichParameter.GetAscii();
+    for ( const auto &written : written_ )
+      {
+        batch.changes_.push_back ( written.second );
+      }
+  }
 
-      throw i3ds::CommandError ( error_value, errorDescription.str() );
-    }
+  BOOST_LOG_TRIVIAL ( info ) << "Replaying " << batch.changes_.size() << " parameter writes";
 
-  BOOST_LOG_TRIVIAL ( info ) << "Boolean parameter: " << whichParameter.GetAscii() << " set to " << status;
+  applyConfiguration ( batch );
 }
 
-
-// Sets an integer Parameter on device
-bool
-i3ds::CosineCamera::setIntParameter ( PvString whichParameter, int64_t value )
+int64_t
+i3ds::CosineCamera::getParameter ( const IntParameter &parameter, bool cached ) const
 {
-  PvGenParameter *lParameter = lParameters->Get ( whichParameter );
+  int64_t lCachedValue = 0;
+  uint64_t changes = 0;
 
-  // Converter generic parameter to width using dynamic cast. If the
-  // type is right, the conversion will work otherwise lWidth will be NULL.
-  PvGenInteger *lvalueParameter = dynamic_cast<PvGenInteger *> ( lParameter );
-  if ( lvalueParameter == NULL )
+  if ( getCachedValue ( parameter, lCachedValue, changes ) && cached )
     {
-      BOOST_LOG_TRIVIAL ( info )
-          << "SetParameter: Unable to get the parameter: "
-          << whichParameter.GetAscii();
-      ostringstream errorDescription;
-      errorDescription << "setIntParameter Option: SetParameter: Unable to get the parameter: "
-                       << whichParameter.GetAscii();
-      throw i3ds::CommandError ( error_value, errorDescription.str() );
+      return lCachedValue;
     }
 
-  int64_t max = getMaxParameter ( whichParameter );
-  if ( value > max )
-    {
-      BOOST_LOG_TRIVIAL ( info ) << "Setting value Error: Parameter: "
-                                 << whichParameter.GetAscii() << " value too big " << value << " (Max: "
-                                 << max << ")";
-
+  BOOST_LOG_TRIVIAL ( info ) << "Fetching parameter: " << parameter.name;
 
-      ostringstream errorDescription;
-      errorDescription << "setIntParameter: " << whichParameter.GetAscii() << " value to large " <<
-                       value << ".(Max: " << max << ")" ;
-      throw i3ds::CommandError ( error_value, errorDescription.str() );
+  std::unique_lock<std::recursive_mutex> lock = lockDevice ( "getParameter" );
+  PvGenInteger *lIntParameter = checkParameter ( parameter, "getParameter" );
 
-    };
+  // Read current width value.
+  int64_t lParameterValue = 0;
 
-  int64_t min = getMinParameter ( whichParameter );
-  if ( value < min )
+  if ( ! ( lIntParameter->GetValue ( lParameterValue ).IsOK() ) )
     {
-      BOOST_LOG_TRIVIAL ( info ) << "Error: value to small " << value << "<"
-                                 << min;
       ostringstream errorDescription;
-      errorDescription << "setIntParameter: " << whichParameter.GetAscii() << " Value to small " <<
-                       value << ".(Min: " << min << ")";
-      throw i3ds::CommandError ( error_value, errorDescription.str() );
-
-    };
-  /// TODO: Increment also?
 
-  PvResult res = lvalueParameter->SetValue ( value );
-
-  if ( !res.IsOK() )
-    {
-      BOOST_LOG_TRIVIAL ( info ) << "SetValue Error: "
-                                 << whichParameter.GetAscii();
+      BOOST_LOG_TRIVIAL ( info ) << "Error retrieving parameter from device";
 
-      ostringstream errorDescription;
-      errorDescription << "setIntParameter: SetValue Error " << whichParameter.GetAscii() ;
+      errorDescription << "getParameter: Error retrieving parameter from device" << parameter.name;
 
       throw i3ds::CommandError ( error_value, errorDescription.str() );
     }
 
-  BOOST_LOG_TRIVIAL ( info ) << "SetValue Ok: " << whichParameter.GetAscii() << "=" << value;
+  BOOST_LOG_TRIVIAL ( info ) << "Parametervalue: " << lParameterValue
+                             << " returned from parameter: " << parameter.name;
+
+  setCachedValue ( parameter, lParameterValue, changes );
 
-  return true;
+  return lParameterValue;
 }
 
-bool
-i3ds::CosineCamera::OpenStream()
+// Fetching minimum allowed value of parameter
+int64_t
+i3ds::CosineCamera::getMinParameter ( const IntParameter &parameter ) const
 {
-  BOOST_LOG_TRIVIAL ( info ) << "--> OpenStream: " << mConnectionID.GetAscii();
-
-  // Creates and open the stream object based on the selected device.
-  PvResult lResult = PvResult::Code::INVALID_PARAMETER;
+  return getRange ( parameter ).min;
+}
 
-  BOOST_LOG_TRIVIAL ( info ) << "--> OpenStream "
-                             << " id: " << mConnectionID.GetAscii()
-                             << " address: " << fetched_ipaddress.GetAscii();
+// Get maximum allowed value of parameter.
+int64_t
+i3ds::CosineCamera::getMaxParameter ( const IntParameter &parameter ) const
+{
+  return getRange ( parameter ).max;
+}
 
-  mStream = PvStream::CreateAndOpen ( fetched_ipaddress.GetAscii(), &lResult );
+std::string
+i3ds::CosineCamera::getEnum ( const EnumParameter &parameter ) const
+{
+  std::string lCachedValue;
+  uint64_t changes = 0;
 
-  if ( !lResult.IsOK() )
+  if ( getCachedValue ( parameter, lCachedValue, changes ) )
     {
-      BOOST_LOG_TRIVIAL ( info ) << "Unable to open the stream";
-      return false;
+      return lCachedValue;
     }
 
-  mPipeline = new PvPipeline ( mStream );
-
-  // Reading payload size from device
-  int64_t lSize = device_->GetPayloadSize();
+  std::unique_lock<std::recursive_mutex> lock = lockDevice ( "getEnum" );
+  PvGenEnum *lGenParameter = checkParameter ( parameter, "getEnum" );
 
-  // Create, init the PvPipeline object
+  // Parameter available?
+  if ( !lGenParameter->IsAvailable() )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "{Not Available}";
+      throw i3ds::CommandError ( error_value, "eBUS: Enum not available" );
+    }
+
+  // Parameter readable?
+  if ( !lGenParameter->IsReadable() )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "{Not readable}";
+      throw i3ds::CommandError ( error_value, "eBUS: Enum not readable" );
+    }
+
+  PvString lValue;
+
+  lGenParameter->GetValue ( lValue );
+
+  BOOST_LOG_TRIVIAL ( info ) << "Enum: " << lValue.GetAscii();
+
+  setCachedValue ( parameter, std::string ( lValue.GetAscii() ), changes );
+
+  return std::string ( lValue.GetAscii() );
+}
+
+bool
+i3ds::CosineCamera::isEnumOption ( const EnumParameter &parameter, PvString value ) const
+{
+  if ( parameter.node == NULL )
+    {
+      return false;
+    }
+
+  for ( const std::string &option : getEnumOptions ( parameter ) )
+    {
+      if ( option == value.GetAscii() )
+        {
+          return true;
+        }
+    }
+
+  return false;
+}
+
+bool
+i3ds::CosineCamera::checkIfEnumOptionIsOK ( const EnumParameter &parameter,
+    PvString value ) const
+{
+  BOOST_LOG_TRIVIAL ( info ) << "checkIfEnumOptionIsOK: Parameter: "
+                             << parameter.name << "Value: " << value.GetAscii();
+
+  if ( isEnumOption ( parameter, value ) )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "Option found.";
+      return true;
+    }
+
+  BOOST_LOG_TRIVIAL ( info ) << "Option not found.";
+
+  ostringstream errorDescription;
+
+  errorDescription << "checkEnum: Option: " << value.GetAscii() << " does not exists for parameter: "
+                   << parameter.name;
+
+  throw i3ds::CommandError ( error_value, errorDescription.str() );
+}
+
+
+void
+i3ds::CosineCamera::setEnum ( const EnumParameter &parameter, PvString value, bool dontCheckParameter )
+{
+  BOOST_LOG_TRIVIAL ( info ) << "setEnum: Parameter: "
+                             << parameter.name << " Value: " << value.GetAscii();
+
+  std::unique_lock<std::recursive_mutex> lock = lockDevice ( "setEnum" );
+  PvGenEnum *lEnumParameter = checkParameter ( parameter, "setEnum" );
+
+  // Throws if the option is not valid, not checked if asked not to.
+  if ( dontCheckParameter == false )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "do checkIfEnumOptionIsOK: Parameter first";
+      checkIfEnumOptionIsOK ( parameter, value );
+    }
+
+  writing_ = lEnumParameter;
+  PvResult res = lEnumParameter->SetValue ( value );
+  writing_ = NULL;
+
+  if ( !res.IsOK() )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "Error setting parameter for device";
+      ostringstream errorDescription;
+      errorDescription << "setEnum: Error setting value: " << value.GetAscii() <<
+                       " for parameter: " << parameter.name;
+
+      throw i3ds::CommandError ( error_value, errorDescription.str() );
+    }
+
+  BOOST_LOG_TRIVIAL ( info ) << "Parameter value: " << value.GetAscii()
+                             << " set for parameter: " << parameter.name;
+
+  setCachedValue ( parameter, std::string ( value.GetAscii() ), parameter.changes );
+  rememberWrite ( parameter, std::string ( value.GetAscii() ) );
+}
+
+bool
+i3ds::CosineCamera::getBooleanParameter ( const BoolParameter &parameter ) const
+{
+  bool lValue = false;
+  uint64_t changes = 0;
+
+  if ( getCachedValue ( parameter, lValue, changes ) )
+    {
+      return lValue;
+    }
+
+  std::unique_lock<std::recursive_mutex> lock = lockDevice ( "getBooleanParameter" );
+  PvGenBoolean *lParameter = checkParameter ( parameter, "getBooleanParameter" );
+
+  lParameter->GetValue ( lValue );
+
+  BOOST_LOG_TRIVIAL ( info ) << parameter.name << " Boolean: " << ( lValue ? "TRUE" : "FALSE" );
+
+  setCachedValue ( parameter, lValue, changes );
+
+  return lValue;
+}
+
+void
+i3ds::CosineCamera::setBooleanParameter ( const BoolParameter &parameter, bool status )
+{
+  std::unique_lock<std::recursive_mutex> lock = lockDevice ( "setBooleanParameter" );
+  PvGenBoolean *lParameter = checkParameter ( parameter, "setBooleanParameter" );
+
+  writing_ = lParameter;
+  PvResult result = lParameter->SetValue ( status );
+  writing_ = NULL;
+
+  if ( result != PvResult::Code::OK )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "Error setting boolean parameter: " << parameter.name << " to " << status;
+
+      ostringstream errorDescription;
+
+      errorDescription << "setBooleanParameter Option: Unable to set the parameter: "
+                       << parameter.name;
+
+      throw i3ds::CommandError ( error_value, errorDescription.str() );
+    }
+
+  BOOST_LOG_TRIVIAL ( info ) << "Boolean parameter: " << parameter.name << " set to " << status;
+
+  setCachedValue ( parameter, status, parameter.changes );
+  rememberWrite ( parameter, status );
+}
+
+
+//
+// Checks a value against the cached range of the parameter. Returns what
+// is wrong with it, or an empty string if it may be written.
+//
+std::string
+i3ds::CosineCamera::checkIntParameter ( const IntParameter &parameter, int64_t value ) const
+{
+  ostringstream errorDescription;
+
+  // Held across the check and the range, so the node is not released between.
+  std::lock_guard<std::recursive_mutex> lock ( device_mutex_ );
+
+  if ( parameter.node == NULL )
+    {
+      errorDescription << "Unable to get the parameter: " << parameter.name;
+      return errorDescription.str();
+    }
+
+  const IntRange range = getRange ( parameter );
+
+  if ( value > range.max )
+    {
+      errorDescription << parameter.name << " value to large " << value << ".(Max: " << range.max << ")";
+    }
+  else if ( value < range.min )
+    {
+      errorDescription << parameter.name << " Value to small " << value << ".(Min: " << range.min << ")";
+    }
+  else if ( ( value - range.min ) % range.increment != 0 )
+    {
+      errorDescription << parameter.name << " Value " << value << " not in steps of "
+                       << range.increment << " from " << range.min;
+    }
+
+  return errorDescription.str();
+}
+
+// Sets an integer Parameter on device
+bool
+i3ds::CosineCamera::setIntParameter ( const IntParameter &parameter, int64_t value )
+{
+  std::unique_lock<std::recursive_mutex> lock = lockDevice ( "setIntParameter" );
+
+  const std::string error = checkIntParameter ( parameter, value );
+
+  if ( !error.empty() )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "Setting value Error: " << error;
+      throw i3ds::CommandError ( error_value, "setIntParameter: " + error );
+    }
+
+  PvGenInteger *lvalueParameter = parameter.node;
+
+  writing_ = lvalueParameter;
+  PvResult res = lvalueParameter->SetValue ( value );
+  writing_ = NULL;
+
+  if ( !res.IsOK() )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "SetValue Error: "
+                                 << parameter.name;
+
+      ostringstream errorDescription;
+      errorDescription << "setIntParameter: SetValue Error " << parameter.name ;
+
+      throw i3ds::CommandError ( error_value, errorDescription.str() );
+    }
+
+  BOOST_LOG_TRIVIAL ( info ) << "SetValue Ok: " << parameter.name << "=" << value;
+
+  setCachedValue ( parameter, value, parameter.changes );
+  rememberWrite ( parameter, value );
+
+  return true;
+}
+
+void
+i3ds::CosineCamera::ConfigBatch::set ( const IntParameter &parameter, int64_t value )
+{
+  Change change = {&parameter, &parameter, NULL, NULL, value, "", false};
+  changes_.push_back ( change );
+}
+
+void
+i3ds::CosineCamera::ConfigBatch::set ( const EnumParameter &parameter, const std::string &value )
+{
+  Change change = {&parameter, NULL, &parameter, NULL, 0, value, false};
+  changes_.push_back ( change );
+}
+
+void
+i3ds::CosineCamera::ConfigBatch::set ( const BoolParameter &parameter, bool value )
+{
+  Change change = {&parameter, NULL, NULL, &parameter, 0, "", value};
+  changes_.push_back ( change );
+}
+
+//
+// Position of a change in the write order. Modes and selectors go first.
+// Auto exposure is switched on before and off after its sub-features, and
+// limits before the values they bound.
+//
+int
+i3ds::CosineCamera::changeOrder ( const ConfigBatch::Change &change ) const
+{
+  const ParameterBase *p = change.parameter;
+
+  if ( p == &params_.acquisition_mode || p == &params_.trigger_mode || p == &params_.source_selector )
+    {
+      return 0;
+    }
+
+  if ( p == &params_.auto_exposure )
+    {
+      return change.enum_value == "ON" ? 1 : 3;
+    }
+
+  if ( change.boolean != NULL )
+    {
+      return 2;
+    }
+
+  if ( p == &params_.max_shutter_time || p == &params_.trigger_interval )
+    {
+      return 4;
+    }
+
+  // Offsets that move the region in go before the sizes, others after.
+  if ( p == &params_.offset_x || p == &params_.offset_y )
+    {
+      return change.int_value < getParameter ( *change.integer ) ? 4 : 6;
+    }
+
+  return 5;
+}
+
+//
+// Writes a single change to the device, throws on failure.
+//
+void
+i3ds::CosineCamera::writeChange ( const ConfigBatch::Change &change )
+{
+  if ( change.integer != NULL )
+    {
+      setIntParameter ( *change.integer, change.int_value );
+    }
+  else if ( change.enumeration != NULL )
+    {
+      setEnum ( *change.enumeration, change.enum_value.c_str(), true );
+    }
+  else
+    {
+      setBooleanParameter ( *change.boolean, change.bool_value );
+    }
+}
+
+//
+// Validates all changes against the cached ranges and options, then writes
+// them in dependency order. If a write fails the changes already written
+// are rolled back. All problems found are reported in one error.
+//
+void
+i3ds::CosineCamera::applyConfiguration ( const ConfigBatch &batch )
+{
+  std::vector<std::string> errors;
+
+  for ( const ConfigBatch::Change &change : batch.changes_ )
+    {
+      std::string error;
+
+      if ( change.integer != NULL )
+        {
+          error = checkIntParameter ( *change.integer, change.int_value );
+        }
+      else if ( change.enumeration != NULL )
+        {
+          if ( !isEnumOption ( *change.enumeration, change.enum_value.c_str() ) )
+            {
+              error = std::string ( change.parameter->name ) + " has no option " + change.enum_value;
+            }
+        }
+      else if ( change.boolean->node == NULL )
+        {
+          error = std::string ( "Unable to get the parameter: " ) + change.parameter->name;
+        }
+
+      if ( !error.empty() )
+        {
+          errors.push_back ( error );
+        }
+    }
+
+  if ( errors.empty() )
+    {
+      // The order of an offset depends on its current value, so compute
+      // each key once rather than reading the device per comparison.
+      std::vector<std::pair<int, ConfigBatch::Change> > changes;
+
+      for ( const ConfigBatch::Change &change : batch.changes_ )
+        {
+          changes.push_back ( std::make_pair ( changeOrder ( change ), change ) );
+        }
+
+      std::stable_sort ( changes.begin(), changes.end(),
+                         [] ( const std::pair<int, ConfigBatch::Change> &a,
+                              const std::pair<int, ConfigBatch::Change> &b )
+      {
+        return a.first < b.first;
+      } );
+
+      std::vector<ConfigBatch::Change> undo;
+
+      for ( const auto &ordered : changes )
+        {
+          const ConfigBatch::Change &change = ordered.second;
+
+          try
+            {
+              ConfigBatch::Change previous = change;
+
+              if ( change.integer != NULL )
+                {
+                  previous.int_value = getParameter ( *change.integer );
+                }
+              else if ( change.enumeration != NULL )
+                {
+                  previous.enum_value = getEnum ( *change.enumeration );
+                }
+              else
+                {
+                  previous.bool_value = getBooleanParameter ( *change.boolean );
+                }
+
+              writeChange ( change );
+              undo.push_back ( previous );
+            }
+          catch ( i3ds::CommandError &e )
+            {
+              errors.push_back ( e.what() );
+              break;
+            }
+        }
+
+      if ( errors.empty() )
+        {
+          return;
+        }
+
+      for ( auto it = undo.rbegin(); it != undo.rend(); ++it )
+        {
+          try
+            {
+              writeChange ( *it );
+            }
+          catch ( i3ds::CommandError &e )
+            {
+              BOOST_LOG_TRIVIAL ( warning ) << "Rollback failed: " << e.what();
+            }
+        }
+    }
+
+  ostringstream errorDescription;
+
+  errorDescription << "applyConfiguration:";
+
+  for ( const std::string &error : errors )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "Configuration error: " << error;
+      errorDescription << " " << error << ";";
+    }
+
+  throw i3ds::CommandError ( error_value, errorDescription.str() );
+}
+
+//
+// Whether a failed device or stream operation may succeed if retried.
+//
+static bool
+isTransient ( const PvResult &result )
+{
+  return result.GetCode() == PvResult::Code::TIMEOUT || result.GetCode() == PvResult::Code::NETWORK_ERROR
+         || result.GetCode() == PvResult::Code::NOT_CONNECTED;
+}
+
+bool
+i3ds::CosineCamera::OpenStream()
+{
+  BOOST_LOG_TRIVIAL ( info ) << "--> OpenStream: " << mConnectionID.GetAscii();
+
+  // Creates and open the stream object based on the selected device.
+  PvResult lResult = PvResult::Code::INVALID_PARAMETER;
+
+  BOOST_LOG_TRIVIAL ( info ) << "--> OpenStream "
+                             << " id: " << mConnectionID.GetAscii()
+                             << " address: " << fetched_ipaddress.GetAscii();
+
+  PvStream *lStream = PvStream::CreateAndOpen ( fetched_ipaddress.GetAscii(), &lResult );
+
+  {
+    std::lock_guard<std::mutex> lock ( run_mutex_ );
+    mStream = lStream;
+  }
+
+  if ( !lResult.IsOK() )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "Unable to open the stream";
+      start_transient_ = isTransient ( lResult );
+      return false;
+    }
+
+  mPipeline = new PvPipeline ( mStream );
+
+  // Reading payload size from device
+  int64_t lSize = 0;
+
+  {
+    std::unique_lock<std::recursive_mutex> lock = lockDevice ( "OpenStream" );
+    lSize = device_->GetPayloadSize();
+  }
+
+  // Create, init the PvPipeline object
   mPipeline->SetBufferSize ( static_cast<uint32_t> ( lSize ) );
-  mPipeline->SetBufferCount ( 16 );
+  mPipeline->SetBufferCount ( bufferCount ( lSize ) );
+
+  starving_ = false;
+  resize_pending_ = false;
+
+  // Block IDs restart with the stream, do not count the jump as a loss.
+  loss_.reset();
+
+  // The pipeline needs to be "armed", or started before  we instruct the device to send us images
+  lResult = mPipeline->Start();
+
+  if ( !lResult.IsOK() )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "Unable to start pipeline";
+      start_transient_ = isTransient ( lResult );
+      return false;
+    }
+
+  applyResendSettings();
+  startDelayTuning ( lSize );
+
+  return true;
+}
+
+//
+// Sets packet size and inter-packet delay. In auto mode the device sends
+// test packets to find the largest size that passes the path, with the
+// given packet size as fallback. The given delay is the starting point of
+// the tuning done while streaming. Otherwise only the values given on the
+// command line are written, and the device keeps its own for the rest.
+//
+void
+i3ds::CosineCamera::configureTransport()
+{
+  PvDeviceGEV *lDeviceGEV = dynamic_cast<PvDeviceGEV *> ( device_ );
+
+  if ( lDeviceGEV == NULL || params_.packet_size.node == NULL )
+    {
+      return;
+    }
+
+  const int64_t size = alignDown ( params_.packet_size,
+                                   std::min<int64_t> ( param_.packet_size, getMaxParameter ( params_.packet_size ) ) );
+
+  if ( options_.auto_transport )
+    {
+      PvResult lResult = lDeviceGEV->NegotiatePacketSize ( 0, static_cast<uint32_t> ( size ) );
+
+      if ( !lResult.IsOK() )
+        {
+          BOOST_LOG_TRIVIAL ( warning ) << "Packet size negotiation failed: " << lResult.GetCodeString().GetAscii();
+        }
+    }
+  else if ( options_.packet_size_given )
+    {
+      setIntParameter ( params_.packet_size, size );
+    }
+
+  if ( params_.packet_delay.node != NULL && ( options_.auto_transport || options_.packet_delay_given ) )
+    {
+      setIntParameter ( params_.packet_delay,
+                        alignDown ( params_.packet_delay,
+                                    std::min<int64_t> ( param_.packet_delay, getMaxParameter ( params_.packet_delay ) ) ) );
+    }
+
+  BOOST_LOG_TRIVIAL ( info ) << ( options_.auto_transport ? "Negotiated" : "Configured" )
+                             << " packet size: " << getParameter ( params_.packet_size, false ) << " bytes"
+                             << ", inter-packet delay: "
+                             << ( params_.packet_delay.node != NULL ? getParameter ( params_.packet_delay, false ) : 0 )
+                             << " ticks";
+}
+
+//
+// Starts the search for the inter-packet delay. The delays of a frame may
+// take up what the link budget leaves of the frame period.
+//
+void
+i3ds::CosineCamera::startDelayTuning ( int64_t payload_size )
+{
+  if ( !options_.auto_transport || link_.isOpen() || params_.packet_delay.node == NULL
+       || params_.packet_size.node == NULL )
+    {
+      return;
+    }
+
+  BandwidthModel model = bandwidthModel();
+
+  model.payload_size = payload_size;
+  model.packet_delay = 0;
+
+  const int64_t packets = model.packets();
+  const double ticks_per_us = tickFrequency() / 1e6;
+  const double spare = std::max ( period() - model.frameTime(), 0.0 );
+
+  const int64_t max = alignDown ( params_.packet_delay,
+                                 std::min<int64_t> ( (int64_t) ( spare * ticks_per_us / packets ),
+                                                     getMaxParameter ( params_.packet_delay ) ) );
+
+  // The steps are whole increments of the delay, so that the search lands
+  // on values the device takes.
+  const int64_t increment = getRange ( params_.packet_delay ).increment;
+  const int64_t step = std::max<int64_t> ( max / 64, (int64_t) ticks_per_us );
+  const int64_t aligned_step = ( ( step + increment - 1 ) / increment ) * increment;
+
+  delay_tuner_.reset ( getParameter ( params_.packet_delay, false ), aligned_step, max );
+
+  BOOST_LOG_TRIVIAL ( info ) << "Tuning inter-packet delay up to " << max << " ticks for "
+                             << packets << " packets per frame";
+}
+
+//
+// Moves the inter-packet delay towards the smallest one without loss.
+//
+void
+i3ds::CosineCamera::tuneDelay ( const LossCounters &loss )
+{
+  if ( !options_.auto_transport || link_.isOpen() || params_.packet_delay.node == NULL )
+    {
+      return;
+    }
+
+  const bool settled = delay_tuner_.settled();
+
+  // Midpoints of the search may fall between increments of the delay.
+  const int64_t before = alignDown ( params_.packet_delay, delay_tuner_.delay() );
+
+  if ( delay_tuner_.update ( loss ) && alignDown ( params_.packet_delay, delay_tuner_.delay() ) != before )
+    {
+      try
+        {
+          setIntParameter ( params_.packet_delay, alignDown ( params_.packet_delay, delay_tuner_.delay() ) );
+        }
+      catch ( i3ds::CommandError &e )
+        {
+          BOOST_LOG_TRIVIAL ( warning ) << "Unable to set inter-packet delay: " << e.what();
+        }
+    }
+
+  if ( delay_tuner_.settled() && !settled )
+    {
+      const int64_t delay = alignDown ( params_.packet_delay, delay_tuner_.delay() );
+
+      BOOST_LOG_TRIVIAL ( info ) << "Selected inter-packet delay: " << delay << " ticks ("
+                                 << delay * 1e6 / tickFrequency() << " us)";
+    }
+}
+
+//
+// Registers the bandwidth this stream needs at the current period with the
+// other streams on the link. Called on start, and again by the sampling
+// thread when the period changes.
+//
+void
+i3ds::CosineCamera::joinLink()
+{
+  if ( !link_.isOpen() )
+    {
+      return;
+    }
+
+  const BandwidthModel model = bandwidthModel();
+  const double demand = model.bandwidth ( period() );
+
+  if ( !link_.join ( demand, (double) model.link_speed ) )
+    {
+      BOOST_LOG_TRIVIAL ( warning ) << "Link group " << options_.link_group << " is full, not coordinating";
+      return;
+    }
+
+  BOOST_LOG_TRIVIAL ( info ) << "Joined link group " << options_.link_group << " needing " << demand << " Mbit/s";
+}
+
+//
+// Paces packets to the share of the link given to this stream, by setting
+// the inter-packet delay so that a packet and its delay take as long as
+// the packet would at the share rate.
+//
+void
+i3ds::CosineCamera::coordinateLink()
+{
+  double share = 0.0;
+  int streams = 0;
+
+  if ( params_.packet_delay.node == NULL || !link_.update ( share, streams ) || share <= 0.0 )
+    {
+      return;
+    }
+
+  const BandwidthModel model = bandwidthModel();
+
+  const double packet_bits = ( model.packet_size + BandwidthModel::wire_overhead ) * 8.0;
+  const double delay_us = std::max ( packet_bits / share - packet_bits / model.link_speed, 0.0 );
+  const int64_t delay = alignDown ( params_.packet_delay,
+                                   std::min<int64_t> ( (int64_t) ( delay_us * tickFrequency() / 1e6 ),
+                                                       getMaxParameter ( params_.packet_delay ) ) );
+
+  try
+    {
+      setIntParameter ( params_.packet_delay, delay );
+    }
+  catch ( i3ds::CommandError &e )
+    {
+      BOOST_LOG_TRIVIAL ( warning ) << "Unable to set inter-packet delay: " << e.what();
+      return;
+    }
+
+  BOOST_LOG_TRIVIAL ( info ) << "Link share " << share << " Mbit/s of " << model.link_speed << " with "
+                             << streams << " streams, inter-packet delay: " << delay << " ticks";
+
+  if ( share < model.bandwidth ( period() ) )
+    {
+      BOOST_LOG_TRIVIAL ( warning ) << "Link group " << options_.link_group << " is oversubscribed, share "
+                                    << share << " Mbit/s is less than the " << model.bandwidth ( period() )
+                                    << " Mbit/s needed";
+    }
+}
+
+//
+// Writes the current resend policy settings to the stream.
+//
+void
+i3ds::CosineCamera::applyResendSettings()
+{
+  const ResendSettings &settings = resend_.settings();
+  PvGenParameterArray *lStreamParameters = mStream->GetParameters();
+
+  // Only for GigE Vision, if supported
+  PvGenBoolean *lRequestMissingPackets =
+    dynamic_cast<PvGenBoolean *> ( lStreamParameters->GetBoolean ( "RequestMissingPackets" ) );
+
+  if ( ( lRequestMissingPackets == NULL ) || !lRequestMissingPackets->IsAvailable() )
+    {
+      return;
+    }
+
+  if ( settings.enabled )
+    {
+      lStreamParameters->SetIntegerValue ( "ResendDelay", settings.delay );
+      lStreamParameters->SetIntegerValue ( "ResendRequestTimeout", settings.timeout );
+      lStreamParameters->SetIntegerValue ( "MaximumResendRequestRetryByPacket", settings.retries );
+    }
+
+  lRequestMissingPackets->SetValue ( settings.enabled );
+
+  BOOST_LOG_TRIVIAL ( info ) << "Request missing packets: " << ( settings.enabled ? "on" : "off" )
+                             << ", delay: " << settings.delay << " ms, timeout: " << settings.timeout
+                             << " ms, retries: " << settings.retries;
+}
+
+//
+// Number of pipeline buffers to allocate for the given payload size. Enough
+// to cover the frame ring and a publisher stall, limited by the budget.
+//
+int
+i3ds::CosineCamera::bufferCount ( int64_t payload_size ) const
+{
+  if ( options_.buffer_count > 0 )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "Pipeline buffer count set to: " << options_.buffer_count;
+      return options_.buffer_count;
+    }
+
+  const int64_t budget = options_.buffer_budget * 1024 * 1024;
+  const int64_t affordable = budget / std::max<int64_t> ( payload_size, 1 );
+
+  const int64_t p = std::max<int64_t> ( period(), 1 );
+  const int64_t wanted = ( BUFFER_STALL_TOLERANCE + p - 1 ) / p + ring_.Capacity() + 2;
+
+  int64_t count = std::min ( wanted, affordable );
+
+  if ( count < MIN_BUFFER_COUNT )
+    {
+      BOOST_LOG_TRIVIAL ( warning ) << "Buffer budget of " << options_.buffer_budget
+                                    << " MiB too small for payload " << payload_size
+                                    << ", using " << MIN_BUFFER_COUNT << " buffers";
+      count = MIN_BUFFER_COUNT;
+    }
+
+  BOOST_LOG_TRIVIAL ( info ) << "Pipeline buffers: " << count << " of " << payload_size << " bytes"
+                             << " (wanted " << wanted << ", budget allows " << affordable << ")";
+
+  return static_cast<int> ( count );
+}
+
+//
+// Reports when every pipeline buffer is waiting in the output queue or the
+// frame ring, leaving none for the stream to fill. Called with the just
+// retrieved buffer still in hand.
+//
+void
+i3ds::CosineCamera::checkStarvation()
+{
+  const int64_t held = mPipeline->GetOutputQueueSize() + ring_.Depth() + 1;
+  const bool starving = held >= mPipeline->GetBufferCount();
+
+  if ( starving && !starving_ )
+    {
+      starvation_events_++;
+
+      BOOST_LOG_TRIVIAL ( warning ) << "Pipeline starved: all " << mPipeline->GetBufferCount()
+                                    << " buffers in use";
+    }
+
+  starving_ = starving;
+}
+
+//
+// Closes the stream, pipeline
+//
+
+void
+i3ds::CosineCamera::CloseStream()
+{
+  BOOST_LOG_TRIVIAL ( info ) << "--> CloseStream";
+
+  // The publisher may hold a buffer from the pipeline, stop it first.
+  StopPublisher();
+  StopStatistics();
+
+  if ( mPipeline != NULL )
+    {
+      if ( mPipeline->IsStarted() )
+        {
+          if ( !mPipeline->Stop().IsOK() )
+            {
+              BOOST_LOG_TRIVIAL ( info ) << "Unable to stop the pipeline.";
+            }
+        }
+
+      delete mPipeline;
+      mPipeline = NULL;
+    }
+
+  if ( mStream != NULL )
+    {
+      if ( mStream->IsOpen() )
+        {
+          if ( !mStream->Close().IsOK() )
+            {
+              BOOST_LOG_TRIVIAL ( info ) << "Unable to stop the stream.";
+            }
+        }
+
+      std::lock_guard<std::mutex> lock ( run_mutex_ );
+
+      PvStream::Free ( mStream );
+      mStream = NULL;
+    }
+}
+
+//
+// Starts image acquisition
+//
+
+bool
+i3ds::CosineCamera::StartAcquisition()
+{
+  BOOST_LOG_TRIVIAL ( info ) << "--> StartAcquisition";
+
+  // Flush packet queue to make sure there is no left over from previous disconnect event
+  PvStreamGEV *lStreamGEV = dynamic_cast<PvStreamGEV *> ( mStream );
+  if ( lStreamGEV != NULL )
+    {
+      lStreamGEV->FlushPacketQueue();
+    }
+
+  std::lock_guard<std::recursive_mutex> lock ( device_mutex_ );
+
+  if ( device_ == NULL )
+    {
+      BOOST_LOG_TRIVIAL ( error ) << "Camera not connected";
+
+      return false;
+    }
+
+  // Set streaming destination (only GigE Vision devces)
+  PvDeviceGEV *lDeviceGEV = dynamic_cast<PvDeviceGEV *> ( device_ );
+  if ( lDeviceGEV != NULL )
+    {
+      // If using a GigE Vision, it is same to assume the stream object is GigE Vision as well
+      PvStreamGEV *lStreamGEV = static_cast<PvStreamGEV *> ( mStream );
+
+      // Have to set the Device IP destination to the Stream
+      PvResult lResult = lDeviceGEV->SetStreamDestination (
+                           lStreamGEV->GetLocalIPAddress(), lStreamGEV->GetLocalPort() );
+      if ( !lResult.IsOK() )
+        {
+          BOOST_LOG_TRIVIAL ( info ) << "Setting stream destination failed"
+                                     << lStreamGEV->GetLocalIPAddress().GetAscii() << ":"
+                                     << lStreamGEV->GetLocalPort();
+
+          start_transient_ = isTransient ( lResult );
+          return false;
+        }
+    }
+
+  // Enables stream before sending the AcquisitionStart command.
+  device_->StreamEnable();
+
+  // The pipeline is already "armed", we just have to tell the device to start sending us images
+  // Runs on the sampling thread, report a missing command instead of throwing.
+  if ( params_.acquisition_start.node == NULL )
+    {
+      BOOST_LOG_TRIVIAL ( error ) << "Camera has no AcquisitionStart command";
+
+      return false;
+    }
+
+  PvResult lResult = params_.acquisition_start.node->Execute();
+
+  if ( !lResult.IsOK() )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "Unable to start acquisition";
+
+      start_transient_ = isTransient ( lResult );
+      return false;
+    }
+
+  return true;
+}
+
+//
+// Stops acquisition
+//
+
+bool
+i3ds::CosineCamera::StopAcquisition()
+{
+  BOOST_LOG_TRIVIAL ( info ) << "--> StopAcquisition";
+
+  std::lock_guard<std::recursive_mutex> lock ( device_mutex_ );
+
+  // Lost and not reconnected, nothing to stop.
+  if ( device_ == NULL )
+    {
+      return true;
+    }
+
+  // Tell the device to stop sending images.
+  if ( params_.acquisition_stop.node != NULL )
+    {
+      params_.acquisition_stop.node->Execute();
+    }
+
+  // Disable stream after sending the AcquisitionStop command.
+  device_->StreamDisable();
+
+  PvDeviceGEV *lDeviceGEV = dynamic_cast<PvDeviceGEV *> ( device_ );
+  if ( lDeviceGEV != NULL )
+    {
+      // Reset streaming destination (optional...)
+      lDeviceGEV->ResetStreamDestination();
+    }
+
+  return true;
+}
+
+//
+// Queues a parameter write on the control thread, replacing a pending
+// write with the same key, and waits up to the command timeout for it.
+// Errors within the timeout are thrown to the caller. A write that has not
+// started by then is cancelled, and the call fails as busy. A write that
+// is already running cannot be taken back. The call then fails as busy
+// with a message saying the write is still in progress, and its result is
+// only logged.
+//
+void
+i3ds::CosineCamera::submitWrite ( const std::string& key, CommandQueue::Command command )
+{
+  std::shared_future<void> result = control_.submit ( key, [key, command]()
+  {
+    try
+      {
+        command();
+      }
+    catch ( std::exception &e )
+      {
+        BOOST_LOG_TRIVIAL ( warning ) << "Writing " << key << " failed: " << e.what();
+        throw;
+      }
+  });
+
+  if ( result.wait_for ( std::chrono::milliseconds ( options_.command_timeout ) ) == std::future_status::ready )
+    {
+      result.get();
+      return;
+    }
+
+  ostringstream errorDescription;
+
+  if ( control_.cancel ( key ) )
+    {
+      errorDescription << "Camera busy, writing " << key << " cancelled after " << options_.command_timeout
+                       << " ms";
+    }
+  else if ( result.wait_for ( std::chrono::seconds ( 0 ) ) == std::future_status::ready )
+    {
+      // Finished while being cancelled.
+      result.get();
+      return;
+    }
+  else
+    {
+      errorDescription << "Camera busy, writing " << key << " still in progress after "
+                       << options_.command_timeout << " ms and will complete";
+    }
+
+  BOOST_LOG_TRIVIAL ( info ) << errorDescription.str();
+
+  throw i3ds::CommandError ( error_other, errorDescription.str() );
+}
+
+//
+// Whether the stream is open and the pipeline armed.
+//
+bool
+i3ds::CosineCamera::isStreamOpen() const
+{
+  return mStream != NULL && mStream->IsOpen() && mPipeline != NULL && mPipeline->IsStarted();
+}
+
+//
+// Returns frames left in the pipeline output queue, that arrived after
+// acquisition was stopped, to the pipeline.
+//
+void
+i3ds::CosineCamera::drainPipeline()
+{
+  PvBuffer *lBuffer = NULL;
+  PvResult lOperationResult;
+  int drained = 0;
+
+  while ( mPipeline->GetOutputQueueSize() > 0
+          && mPipeline->RetrieveNextBuffer ( &lBuffer, 0, &lOperationResult ).IsOK() )
+    {
+      mPipeline->ReleaseBuffer ( lBuffer );
+      drained++;
+    }
+
+  if ( drained > 0 )
+    {
+      BOOST_LOG_TRIVIAL ( debug ) << "Drained " << drained << " stale buffers from pipeline";
+    }
+}
+
+//
+// Stops acquisition, publishing and statistics, but keeps the stream open
+// and the pipeline armed for the next start.
+//
+void
+i3ds::CosineCamera::PauseStreaming()
+{
+  BOOST_LOG_TRIVIAL ( info ) << "--> PauseStreaming";
+
+  StopAcquisition();
+
+  // The publisher may hold buffers from the pipeline, stop it first.
+  StopPublisher();
+  StopStatistics();
+
+  drainPipeline();
+}
+
+//
+// Tear down: closes, disconnects, etc.
+//
+void
+i3ds::CosineCamera::TearDown ( bool aStopAcquisition )
+{
+  BOOST_LOG_TRIVIAL ( info ) << "--> TearDown";
+
+  if ( aStopAcquisition )
+    {
+      StopAcquisition();
+    }
+
+  CloseStream();
+  //DisconnectDevice();
+}
+
+//
+// Classifies the operation result of a retrieved buffer.
+//
+static i3ds::FrameOutcome
+frameOutcome ( const PvResult &result )
+{
+  if ( result.IsOK() )
+    {
+      return i3ds::FrameOutcome::good;
+    }
+
+  if ( result.GetCode() == PvResult::Code::TIMEOUT )
+    {
+      return i3ds::FrameOutcome::timed_out;
+    }
+
+  // Missing packets, failed resends, buffer too small, aborted, etc.
+  return i3ds::FrameOutcome::incomplete;
+}
+
+//
+// Opens the stream, starts publishing and acquisition. Tears down again on
+// failure.
+//
+bool
+i3ds::CosineCamera::StartStreaming()
+{
+  bool opened = false;
+
+  start_transient_ = false;
+
+  // Runs on the sampling thread, where a parameter error must not escape.
+  try
+    {
+      if ( isStreamOpen() )
+        {
+          // Warm stream, armed since Open() or the last stop.
+          if ( resize_pending_.exchange ( false ) )
+            {
+              resizeBuffers();
+            }
+
+          drainPipeline();
+          loss_.reset();
+          applyResendSettings();
+          opened = true;
+        }
+      // Device is connected, open the stream
+      else
+        {
+          opened = OpenStream();
+        }
+    }
+  catch ( i3ds::CommandError &e )
+    {
+      BOOST_LOG_TRIVIAL ( error ) << "OpenStream failed: " << e.what();
+    }
+
+  if ( !opened )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "-->OpenStream Error";
+      samplingErrorFlag = true;
+      strncpy ( samplingErrorText, "StartAcqisition error", 25 );
+
+      TearDown ( false );
+      return false;
+    }
+
+  BOOST_LOG_TRIVIAL ( info ) << "OpenStream went well--> startAcquistion";
+  StartPublisher();
+  StartStatistics();
+
+  // Device is connected, stream is opened: start acquisition
+  if ( !StartAcquisition() )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "--> StartAcquisition error";
+      samplingErrorFlag = true;
+      strncpy ( samplingErrorText, "StartAcqisition error", 25 );
+
+      TearDown ( false );
+      return false;
+    }
+
+  return true;
+}
+
+//
+// Connects to the camera again after the link was lost, with exponential
+// backoff between attempts. The configuration written before is replayed
+// and streaming resumed. Returns false if stopped first, or if streaming
+// fails in a way retrying will not fix.
+//
+bool
+i3ds::CosineCamera::Reconnect()
+{
+  const auto lost = std::chrono::steady_clock::now();
+  std::chrono::milliseconds backoff = RECONNECT_MIN_BACKOFF;
+
+  // Writes queued meanwhile wait for the new device, and go to it after
+  // the replayed configuration.
+  control_.pause();
+
+  DisconnectDevice();
+
+  for ( int attempt = 1; isRunning(); attempt++ )
+    {
+      BOOST_LOG_TRIVIAL ( info ) << "Reconnect attempt " << attempt;
+
+      try
+        {
+          ConnectDevice();
+          SetupDevice();
+          replayConfiguration();
+
+          control_.resume();
+
+          if ( StartStreaming() )
+            {
+              const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds> (
+                                     std::chrono::steady_clock::now() - lost );
+
+              last_recovery_time_ = elapsed.count();
+              recoveries_++;
+              samplingErrorFlag = false;
+
+              BOOST_LOG_TRIVIAL ( info ) << "Reconnected in " << elapsed.count() / 1000 << " ms after "
+                                         << attempt << " attempts, recoveries: " << recoveries_;
+              return true;
+            }
+
+          if ( !mConnectionLost && !start_transient_ )
+            {
+              // Connected, but streaming would fail the same way again.
+              BOOST_LOG_TRIVIAL ( error ) << "Unable to resume streaming after reconnect, not retrying";
+              setState ( AcquisitionState::idle, "resume failed" );
+              return false;
+            }
+        }
+      catch ( i3ds::CommandError &e )
+        {
+          BOOST_LOG_TRIVIAL ( warning ) << "Reconnect failed: " << e.what();
+        }
+
+      control_.pause();
+      DisconnectDevice();
+
+      if ( !waitRunning ( backoff ) )
+        {
+          break;
+        }
+
+      backoff = std::min ( 2 * backoff, RECONNECT_MAX_BACKOFF );
+    }
+
+  BOOST_LOG_TRIVIAL ( info ) << "Stopped while reconnecting";
+
+  control_.resume();
+
+  return false;
+}
+
+//
+// Waits for the timeout or until stopped. Returns true if still running.
+//
+bool
+i3ds::CosineCamera::waitRunning ( std::chrono::milliseconds timeout )
+{
+  std::unique_lock<std::mutex> lock ( run_mutex_ );
+
+  run_cond_.wait_for ( lock, timeout, [this]() {return !isRunning();} );
+
+  return isRunning();
+}
+
+static const char*
+stateName ( i3ds::CosineCamera::AcquisitionState state )
+{
+  switch ( state )
+    {
+    case i3ds::CosineCamera::AcquisitionState::idle:
+      return "idle";
+    case i3ds::CosineCamera::AcquisitionState::opening:
+      return "opening";
+    case i3ds::CosineCamera::AcquisitionState::streaming:
+      return "streaming";
+    case i3ds::CosineCamera::AcquisitionState::recovering:
+      return "recovering";
+    case i3ds::CosineCamera::AcquisitionState::stopping:
+      return "stopping";
+    }
+
+  return "unknown";
+}
+
+//
+// Whether the acquisition thread should keep going.
+//
+bool
+i3ds::CosineCamera::isRunning() const
+{
+  const AcquisitionState state = state_;
+
+  return state != AcquisitionState::idle && state != AcquisitionState::stopping;
+}
+
+//
+// Moves to the given state, unless stopping, which only Stop() may leave.
+// Returns false if the state was not changed.
+//
+bool
+i3ds::CosineCamera::setState ( AcquisitionState state, const char* reason )
+{
+  std::lock_guard<std::mutex> lock ( run_mutex_ );
+
+  if ( state_ == AcquisitionState::stopping && state != AcquisitionState::idle )
+    {
+      return false;
+    }
+
+  recordState ( state, reason );
+
+  return true;
+}
+
+//
+// Changes state, timestamps the transition and wakes waiters. Called with
+// run_mutex_ held.
+//
+void
+i3ds::CosineCamera::recordState ( AcquisitionState state, const char* reason )
+{
+  StateTransition transition;
+
+  transition.from = state_;
+  transition.to = state;
+  transition.time = std::chrono::duration_cast<std::chrono::microseconds> (
+                      std::chrono::system_clock::now().time_since_epoch() ).count();
+  transition.reason = reason;
+
+  state_ = state;
+
+  transitions_.push_back ( transition );
+
+  if ( transitions_.size() > STATE_HISTORY )
+    {
+      transitions_.pop_front();
+    }
+
+  BOOST_LOG_TRIVIAL ( info ) << "Acquisition " << stateName ( transition.from ) << " -> "
+                             << stateName ( transition.to ) << ": " << reason;
+
+  run_cond_.notify_all();
+}
+
+std::vector<i3ds::CosineCamera::StateTransition>
+i3ds::CosineCamera::stateTransitions() const
+{
+  std::lock_guard<std::mutex> lock ( run_mutex_ );
+  return std::vector<StateTransition> ( transitions_.begin(), transitions_.end() );
+}
+
+//
+// Runs acquisition from opening until stopped, recovering from a lost
+// camera on the way.
+//
+void
+i3ds::CosineCamera::SamplingLoop()
+{
+  BOOST_LOG_TRIVIAL ( info ) << "--> SamplingLoop";
+
+  first_frame_pending_ = true;
+
+  while ( isRunning() )
+    {
+      switch ( state_ )
+        {
+        case AcquisitionState::opening:
+
+          if ( mConnectionLost )
+            {
+              setState ( AcquisitionState::recovering, "connection lost while stopped" );
+            }
+          else if ( StartStreaming() )
+            {
+              setState ( AcquisitionState::streaming, "acquisition started" );
+            }
+          else if ( mConnectionLost || start_transient_ )
+            {
+              setState ( AcquisitionState::recovering, "start failed" );
+            }
+          else
+            {
+              // Would fail the same way again, leave it to the operator.
+              BOOST_LOG_TRIVIAL ( error ) << "Unable to start streaming, not retrying";
+              setState ( AcquisitionState::idle, "start failed" );
+            }
+
+          break;
+
+        case AcquisitionState::streaming:
+
+          if ( mConnectionLost )
+            {
+              samplingErrorFlag = true;
+              strncpy ( samplingErrorText, "Connection to camera lost", 25 );
+
+              setState ( AcquisitionState::recovering, "connection lost" );
+            }
+          else if ( !isStreamOpen() )
+            {
+              setState ( AcquisitionState::recovering, "stream closed" );
+            }
+          else
+            {
+              acquireFrame();
+            }
+
+          break;
+
+        case AcquisitionState::recovering:
+
+          // Device lost: no need to stop acquisition
+          TearDown ( false );
+
+          if ( Reconnect() )
+            {
+              setState ( AcquisitionState::streaming, "reconnected" );
+            }
+
+          break;
+
+        default:
+          break;
+        }
+    }
+
+  BOOST_LOG_TRIVIAL ( info ) << "--> Sampling Loop Exiting";
+}
+
+//
+// Waits for the next frame and queues it for publishing.
+//
+void
+i3ds::CosineCamera::acquireFrame()
+{
+  // Start over if the trigger period was changed while streaming, and tell
+  // the link group what the stream needs at the new period.
+  if ( period() != stall_period_ )
+    {
+      stall_period_ = period();
+      stall_.reset ( stall_period_ );
+      joinLink();
+    }
+
+  timeout_ = stall_.timeout();
+
+  if ( resize_pending_.exchange ( false ) )
+    {
+      resizeBuffers();
+    }
+
+  PvBuffer *lBuffer = NULL;
+  PvResult lOperationResult;
+
+  PvResult lResult = retrieveBuffer ( &lBuffer, &lOperationResult );
+
+  if ( lResult.IsOK() && lOperationResult.GetCode() == PvResult::Code::ABORTED )
+    {
+      // Aborted by Stop() or link loss, not a loss of frames.
+      mPipeline->ReleaseBuffer ( lBuffer );
+    }
+  else if ( lResult.IsOK() )
+    {
+      checkStarvation();
+
+      stall_.arrival ( std::chrono::duration_cast<std::chrono::microseconds> (
+                         std::chrono::steady_clock::now().time_since_epoch() ).count() );
+      frame_interval_ = stall_.interval();
+
+      if ( first_frame_pending_ )
+        {
+          first_frame_pending_ = false;
+          start_latency_ = elapsed_us ( start_time_ );
+
+          BOOST_LOG_TRIVIAL ( info ) << "First frame " << start_latency_ / 1000.0 << " ms after start ("
+                                     << ( options_.warm_stream ? "warm" : "cold" ) << " stream)";
+        }
+
+      loss_.frame ( lBuffer->GetBlockID(), frameOutcome ( lOperationResult ),
+                    lBuffer->GetLostPacketCount(), lBuffer->GetPacketsRecoveredCount() );
+
+      if ( lOperationResult.IsOK() && lBuffer->GetPayloadType() == PvPayloadTypeImage )
+        {
+          // The buffer goes back to the pipeline once published.
+          queueFrame ( lBuffer );
+        }
+      else
+        {
+          // VERY IMPORTANT, release the buffer back to the pipeline.
+          mPipeline->ReleaseBuffer ( lBuffer );
+        }
+    }
+  else if ( !isRunning() || mConnectionLost )
+    {
+      // Woken to stop or recover.
+    }
+  else if ( lResult.GetCode() == PvResult::Code::TIMEOUT )
+    {
+      if ( param_.external_trigger && !stall_.learned() )
+        {
+          // Nothing to judge a stall by until triggers have been seen.
+          FRAME_LOG_LIMITED ( info, timeout_log_ ) << "No frame in " << timeout_ << " ms, waiting for triggers";
+
+          stall_.stall();
+          return;
+        }
+
+      stall_events_++;
+
+      BOOST_LOG_TRIVIAL ( warning ) << "Stream stalled, no frame in " << timeout_ << " ms, expected every "
+                                    << stall_.interval() / 1000.0 << " ms, restarting stream";
+
+      stall_.stall();
+      restartStream();
+    }
+  else
+    {
+      FRAME_LOG_LIMITED ( warning, timeout_log_ ) << "sampling failed without receiving image: "
+                                                  << lResult.GetCodeString().GetAscii();
+    }
+}
+
+//
+// Restarts acquisition after a stall. The stream stays open and the
+// pipeline armed, only the device is stopped and started again.
+//
+void
+i3ds::CosineCamera::restartStream()
+{
+  StopAcquisition();
+  drainPipeline();
+
+  // Frames not sent while stalled are not lost, and block IDs may restart.
+  loss_.reset();
+
+  start_transient_ = false;
+
+  if ( StartAcquisition() )
+    {
+      return;
+    }
 
-  // The pipeline needs to be "armed", or started before  we instruct the device to send us images
-  lResult = mPipeline->Start();
+  samplingErrorFlag = true;
+  strncpy ( samplingErrorText, "StartAcqisition error", 25 );
 
-  if ( !lResult.IsOK() )
+  if ( mConnectionLost || start_transient_ )
     {
-      BOOST_LOG_TRIVIAL ( info ) << "Unable to start pipeline";
-      return false;
+      setState ( AcquisitionState::recovering, "stream restart failed" );
+    }
+  else
+    {
+      BOOST_LOG_TRIVIAL ( error ) << "Unable to restart acquisition, not retrying";
+      setState ( AcquisitionState::idle, "stream restart failed" );
     }
+}
 
-  // Only for GigE Vision, if supported
-  PvGenBoolean *lRequestMissingPackets =
-    dynamic_cast<PvGenBoolean *> ( mStream->GetParameters()->GetBoolean (
-                                     "RequestMissingPackets" ) );
+//
+// Waits up to the frame timeout for the next buffer. Stop() and link loss
+// abort the queued buffers, which ends the wait at once, but there may be
+// none queued. The wait is therefore made in slices, and a stop or lost
+// connection is noticed within one.
+//
+PvResult
+i3ds::CosineCamera::retrieveBuffer ( PvBuffer **aBuffer, PvResult *aOperationResult )
+{
+  PvResult lResult = PvResult::Code::TIMEOUT;
 
-  if ( ( lRequestMissingPackets != NULL )
-       && lRequestMissingPackets->IsAvailable() )
+  for ( int waited = 0; waited < timeout_; waited += RETRIEVE_SLICE )
     {
-      // Disabling request missing packets.
-      lRequestMissingPackets->SetValue ( false );
+      if ( !isRunning() || mConnectionLost )
+        {
+          return PvResult::Code::ABORTED;
+        }
+
+      const int slice = std::min ( RETRIEVE_SLICE, timeout_ - waited );
+
+      lResult = mPipeline->RetrieveNextBuffer ( aBuffer, slice, aOperationResult );
+
+      if ( lResult.GetCode() != PvResult::Code::TIMEOUT )
+        {
+          break;
+        }
     }
 
-  return true;
+  return lResult;
 }
 
 //
-// Closes the stream, pipeline
+// Starts the thread publishing frames from the ring.
 //
+void
+i3ds::CosineCamera::StartPublisher()
+{
+  ring_.Reset();
+  publishing_ = true;
+  publish_thread_ = std::thread ( &i3ds::CosineCamera::PublishLoop, this );
+}
 
+//
+// Stops the publisher and returns unpublished buffers to the pipeline.
+//
 void
-i3ds::CosineCamera::CloseStream()
+i3ds::CosineCamera::StopPublisher()
 {
-  BOOST_LOG_TRIVIAL ( info ) << "--> CloseStream";
+  publishing_ = false;
+  ring_.Interrupt();
 
-  if ( mPipeline != NULL )
+  if ( publish_thread_.joinable() )
     {
-      if ( mPipeline->IsStarted() )
+      publish_thread_.join();
+    }
+
+  PvBuffer *lBuffer = NULL;
+
+  while ( ring_.TryPop ( lBuffer ) )
+    {
+      mPipeline->ReleaseBuffer ( lBuffer );
+    }
+}
+
+void
+i3ds::CosineCamera::PublishLoop()
+{
+  BOOST_LOG_TRIVIAL ( info ) << "--> PublishLoop";
+
+  // An interrupted ring no longer waits, so leave once stopping.
+  while ( publishing_ && isRunning() )
+    {
+      PvBuffer *lBuffer = NULL;
+
+      if ( ring_.WaitPop ( lBuffer, std::chrono::milliseconds ( 100 ) ) )
         {
-          if ( !mPipeline->Stop().IsOK() )
-            {
-              BOOST_LOG_TRIVIAL ( info ) << "Unable to stop the pipeline.";
-            }
+          publishFrame ( lBuffer );
         }
-
-      delete mPipeline;
-      mPipeline = NULL;
     }
 
-  if ( mStream != NULL )
+  BOOST_LOG_TRIVIAL ( info ) << "--> Publish Loop Exiting";
+}
+
+//
+// Hands a good buffer to the publisher, applying the overflow policy if
+// the publisher has fallen behind.
+//
+void
+i3ds::CosineCamera::queueFrame ( PvBuffer *buffer )
+{
+  bool queued = ring_.TryPush ( buffer );
+
+  if ( !queued )
     {
-      if ( mStream->IsOpen() )
+      ring_overflows_++;
+
+      switch ( options_.overflow )
         {
-          if ( !mStream->Close().IsOK() )
+        case OverflowPolicy::drop_oldest:
+        {
+          PvBuffer *lOldest = NULL;
+
+          if ( ring_.TryPop ( lOldest ) )
             {
-              BOOST_LOG_TRIVIAL ( info ) << "Unable to stop the stream.";
+              mPipeline->ReleaseBuffer ( lOldest );
             }
+
+          queued = ring_.TryPush ( buffer );
+          break;
         }
 
-      PvStream::Free ( mStream );
-      mStream = NULL;
+        case OverflowPolicy::drop_newest:
+          break;
+
+        case OverflowPolicy::block:
+          while ( publishing_ && isRunning() && !queued )
+            {
+              ring_.WaitSpace ( std::chrono::milliseconds ( 100 ) );
+              queued = ring_.TryPush ( buffer );
+            }
+          break;
+        }
+    }
+
+  if ( !queued )
+    {
+      mPipeline->ReleaseBuffer ( buffer );
+      return;
+    }
+
+  int depth = ring_.Depth();
+  int peak = peak_ring_depth_;
+
+  while ( depth > peak && !peak_ring_depth_.compare_exchange_weak ( peak, depth ) )
+    {
     }
 }
 
 //
-// Starts image acquisition
+// Starts the thread sampling stream statistics.
 //
+void
+i3ds::CosineCamera::StartStatistics()
+{
+  {
+    std::lock_guard<std::mutex> lock ( stats_mutex_ );
+    sampling_stats_ = true;
+  }
 
-bool
-i3ds::CosineCamera::StartAcquisition()
+  stats_thread_ = std::thread ( &i3ds::CosineCamera::StatisticsLoop, this );
+}
+
+void
+i3ds::CosineCamera::StopStatistics()
 {
-  BOOST_LOG_TRIVIAL ( info ) << "--> StartAcquisition";
+  {
+    std::lock_guard<std::mutex> lock ( stats_mutex_ );
+    sampling_stats_ = false;
+  }
 
-  // Flush packet queue to make sure there is no left over from previous disconnect event
-  PvStreamGEV *lStreamGEV = dynamic_cast<PvStreamGEV *> ( mStream );
-  if ( lStreamGEV != NULL )
+  stats_cond_.notify_all();
+
+  if ( stats_thread_.joinable() )
     {
-      lStreamGEV->FlushPacketQueue();
+      stats_thread_.join();
     }
+}
 
-  // Set streaming destination (only GigE Vision devces)
-  PvDeviceGEV *lDeviceGEV = dynamic_cast<PvDeviceGEV *> ( device_ );
-  if ( lDeviceGEV != NULL )
+//
+// Reads the stream statistics at a low rate, keeping the GenICam lookups
+// out of the frame path.
+//
+void
+i3ds::CosineCamera::StatisticsLoop()
+{
+  BOOST_LOG_TRIVIAL ( info ) << "--> StatisticsLoop";
+
+  std::unique_lock<std::mutex> lock ( stats_mutex_ );
+
+  while ( sampling_stats_ )
     {
-      // If using a GigE Vision, it is same to assume the stream object is GigE Vision as well
-      PvStreamGEV *lStreamGEV = static_cast<PvStreamGEV *> ( mStream );
+      lock.unlock();
 
-      // Have to set the Device IP destination to the Stream
-      PvResult lResult = lDeviceGEV->SetStreamDestination (
-                           lStreamGEV->GetLocalIPAddress(), lStreamGEV->GetLocalPort() );
-      if ( !lResult.IsOK() )
+      try
         {
-          BOOST_LOG_TRIVIAL ( info ) << "Setting stream destination failed"
-                                     << lStreamGEV->GetLocalIPAddress().GetAscii() << ":"
-                                     << lStreamGEV->GetLocalPort();
-
-          return false;
+          sampleStatistics();
+        }
+      catch ( i3ds::CommandError &e )
+        {
+          BOOST_LOG_TRIVIAL ( warning ) << "Unable to sample statistics: " << e.what();
         }
+
+      lock.lock();
+
+      stats_cond_.wait_for ( lock, std::chrono::milliseconds ( options_.stats_period ),
+                             [this]() {return !sampling_stats_;} );
     }
 
-  // Enables stream before sending the AcquisitionStart command.
-  device_->StreamEnable();
+  BOOST_LOG_TRIVIAL ( info ) << "--> Statistics Loop Exiting";
+}
 
-  // The pipeline is already "armed", we just have to tell the device to start sending us images
-  PvResult lResult = device_->GetParameters()->ExecuteCommand ( "AcquisitionStart" );
+void
+i3ds::CosineCamera::sampleStatistics()
+{
+  StreamStatistics stats;
 
-  if ( !lResult.IsOK() )
+  stats.sampled = std::chrono::steady_clock::now();
+
+  PvGenParameterArray *lStreamParameters = mStream->GetParameters();
+
+  lStreamParameters->GetIntegerValue ( "BlockCount", stats.block_count );
+  lStreamParameters->GetFloatValue ( "AcquisitionRate", stats.acquisition_rate );
+  lStreamParameters->GetFloatValue ( "Bandwidth", stats.bandwidth );
+
+  stats.buffer_count = mPipeline->GetBufferCount();
+  stats.ring_depth = ring_.Depth();
+  stats.ring_overflows = ring_overflows_;
+  stats.starvation_events = starvation_events_;
+
+  synchronizeClock();
+
+  stats.loss = loss_.counters();
+  loss_window_.add ( stats.sampled, stats.loss );
+
+  stats.frame_loss_rate = loss_window_.frameLossRate();
+  stats.missing_packet_rate = loss_window_.missingPacketRate();
+  stats.recovered_packet_rate = loss_window_.recoveredPacketRate();
+
+  if ( resend_.update ( stats.sampled, stats.loss ) )
     {
-      BOOST_LOG_TRIVIAL ( info ) << "Unable to start acquisition";
+      applyResendSettings();
+    }
 
-      return false;
+  tuneDelay ( stats.loss );
+  coordinateLink();
+
+  stats.resend_enabled = resend_.settings().enabled;
+  stats.frame_interval = frame_interval_;
+  stats.stall_events = stall_events_;
+  stats.recoveries = recoveries_;
+  stats.last_recovery_time = last_recovery_time_;
+
+  if ( stats.frame_loss_rate > 0.0 )
+    {
+      BOOST_LOG_TRIVIAL ( warning ) << "Frame loss " << stats.frame_loss_rate * 100.0 << "% over "
+                                    << LOSS_WINDOW.count() << " s, total dropped: " << stats.loss.dropped
+                                    << " incomplete: " << stats.loss.incomplete
+                                    << " timed out: " << stats.loss.timed_out
+                                    << " missing packets: " << stats.loss.missing_packets;
     }
 
-  return true;
+  stats.clock_drift = clock_.drift();
+  stats.clock_error = clock_.error();
+
+  BOOST_LOG_TRIVIAL ( debug ) << "Stream blocks: " << stats.block_count
+                              << " rate: " << stats.acquisition_rate
+                              << " bandwidth: " << stats.bandwidth;
+
+  std::lock_guard<std::mutex> lock ( stats_mutex_ );
+  stats_ = stats;
+}
+
+i3ds::StreamStatistics
+i3ds::CosineCamera::streamStatistics() const
+{
+  std::lock_guard<std::mutex> lock ( stats_mutex_ );
+  return stats_;
 }
 
 //
-// Stops acquisition
+// Link budget of the current configuration.
 //
-
-bool
-i3ds::CosineCamera::StopAcquisition()
+i3ds::BandwidthModel
+i3ds::CosineCamera::bandwidthModel() const
 {
-  BOOST_LOG_TRIVIAL ( info ) << "--> StopAcquisition";
+  BandwidthModel model;
 
-  // Tell the device to stop sending images.
-  device_->GetParameters()->ExecuteCommand ( "AcquisitionStop" );
+  std::unique_lock<std::recursive_mutex> lock = lockDevice ( "bandwidthModel" );
 
-  // Disable stream after sending the AcquisitionStop command.
-  device_->StreamDisable();
+  model.payload_size = device_->GetPayloadSize();
+  model.packet_size = params_.packet_size.node != NULL ? getParameter ( params_.packet_size ) : 1500;
+  model.packet_delay = params_.packet_delay.node != NULL ? getParameter ( params_.packet_delay ) : 0;
+  model.tick_frequency = tickFrequency();
+  model.link_speed = params_.link_speed.node != NULL ? getParameter ( params_.link_speed ) : 1000;
 
-  PvDeviceGEV *lDeviceGEV = dynamic_cast<PvDeviceGEV *> ( device_ );
-  if ( lDeviceGEV != NULL )
+  return model;
+}
+
+double
+i3ds::CosineCamera::maxFrameRate() const
+{
+  return bandwidthModel().maxFrameRate();
+}
+
+//
+// Returns why frames cannot be delivered at the given period, or an empty
+// string if they can.
+//
+std::string
+i3ds::CosineCamera::checkPeriod ( int64_t period_us ) const
+{
+  const BandwidthModel model = bandwidthModel();
+
+  if ( period_us >= model.minPeriod() )
     {
-      // Reset streaming destination (optional...)
-      lDeviceGEV->ResetStreamDestination();
+      return std::string();
     }
 
-  return true;
+  ostringstream error;
+
+  error << "Period " << period_us << " us is not sustainable, " << model.payload_size
+        << " byte frames in " << model.packets() << " packets of " << model.packet_size
+        << " bytes with " << model.packet_delay << " ticks delay need " << model.minPeriod()
+        << " us on a " << model.link_speed << " Mbit/s link (max " << model.maxFrameRate() << " Hz)";
+
+  return error.str();
 }
 
 //
-// Tear down: closes, disconnects, etc.
+// Nominal device timestamp frequency in Hz, also the unit of GevSCPD.
 //
-void
-i3ds::CosineCamera::TearDown ( bool aStopAcquisition )
+double
+i3ds::CosineCamera::tickFrequency() const
 {
-  BOOST_LOG_TRIVIAL ( info ) << "--> TearDown";
+  std::lock_guard<std::recursive_mutex> lock ( device_mutex_ );
 
-  if ( aStopAcquisition )
+  if ( params_.timestamp_tick_frequency.node == NULL )
     {
-      StopAcquisition();
+      return 1e9;
     }
 
-  CloseStream();
-  //DisconnectDevice();
+  return (double) getParameter ( params_.timestamp_tick_frequency );
 }
 
+//
+// Starts a new clock model at the nominal tick frequency of the device.
+//
 void
-i3ds::CosineCamera::SamplingLoop()
+i3ds::CosineCamera::resetClock()
 {
-  BOOST_LOG_TRIVIAL ( info ) << "--> SamplingLoop";
+  const double frequency = tickFrequency();
+
+  clock_.reset ( frequency );
+
+  // The fit is on the steady clock, so that host clock adjustments do not
+  // show up as drift. It is converted to system time with this offset.
+  const auto system = std::chrono::system_clock::now().time_since_epoch();
+  const auto steady = std::chrono::steady_clock::now().time_since_epoch();
+
+  clock_epoch_ = std::chrono::duration_cast<std::chrono::microseconds> ( system - steady ).count();
+
+  BOOST_LOG_TRIVIAL ( info ) << "Device timestamp tick frequency: " << frequency << " Hz";
+}
+
+//
+// Latches the device timestamp and pairs it with the midpoint of the host
+// time around the latch, adding a point to the clock model.
+//
+void
+i3ds::CosineCamera::synchronizeClock()
+{
+  std::lock_guard<std::recursive_mutex> lock ( device_mutex_ );
+
+  if ( params_.timestamp_latch.node == NULL || params_.timestamp_value.node == NULL )
+    {
+      return;
+    }
 
-  bool first = true;
+  const auto before = std::chrono::steady_clock::now();
+  const PvResult lResult = params_.timestamp_latch.node->Execute();
+  const auto after = std::chrono::steady_clock::now();
 
-  int64_t lImageCountVal = 0;
-  double lFrameRateVal = 0.0;
-  double lBandwidthVal = 0.0;
+  int64_t ticks = 0;
 
-  // Acquire images until the user instructs us to stop.
-  while (running_)
+  if ( !lResult.IsOK() || !params_.timestamp_value.node->GetValue ( ticks ).IsOK() )
     {
+      BOOST_LOG_TRIVIAL ( warning ) << "Unable to latch device timestamp";
+      return;
+    }
 
-      //If connection flag is up, teardown device/stream
-      if ( mConnectionLost && ( device_ != NULL ) )
-        {
-          // Device lost: no need to stop acquisition
-          samplingErrorFlag = true;
-          strncpy ( samplingErrorText, "Connection to camera lost", 25 );
-          TearDown ( false );
-        }
+  const int64_t t0 = std::chrono::duration_cast<std::chrono::microseconds> ( before.time_since_epoch() ).count();
+  const int64_t t1 = std::chrono::duration_cast<std::chrono::microseconds> ( after.time_since_epoch() ).count();
 
-      // Only set up stream first time and do not try to reconnect
-      if ( first )
-        {
-          BOOST_LOG_TRIVIAL ( info ) << "First sample-> round initialise";
-          // Device is connected, open the stream
-          if ( OpenStream() )
-            {
-              BOOST_LOG_TRIVIAL ( info ) << "OpenStream went well--> startAcquistion";
-              // Device is connected, stream is opened: start acquisition
-              if ( !StartAcquisition() )
-                {
-                  BOOST_LOG_TRIVIAL ( info ) << "--> StartAcquisition error";
-                  samplingErrorFlag = true;
-                  strncpy ( samplingErrorText, "StartAcqisition error", 25 );
+  clock_.addPoint ( (uint64_t) ticks, ( t0 + t1 ) / 2, ( t1 - t0 ) / 2.0 );
 
-                  TearDown ( false );
-                }
-            }
-          else
-            {
-              BOOST_LOG_TRIVIAL ( info ) << "-->OpenStream Error";
-              samplingErrorFlag = true;
-              strncpy ( samplingErrorText, "StartAcqisition error", 25 );
+  BOOST_LOG_TRIVIAL ( debug ) << "Clock sync round trip: " << t1 - t0 << " us, drift: "
+                              << clock_.drift() << " ppm, error: " << clock_.error() << " us";
+}
 
-              TearDown ( false );
-            }
+i3ds::CosineCamera::FrameTiming
+i3ds::CosineCamera::frameTiming() const
+{
+  std::lock_guard<std::mutex> lock ( timing_mutex_ );
+  return timing_;
+}
 
-          first = false;
-        }
+i3ds::CosineCamera::ConnectTiming
+i3ds::CosineCamera::connectTiming() const
+{
+  std::lock_guard<std::mutex> lock ( timing_mutex_ );
+  return connect_timing_;
+}
 
-      // If still no device, no need to continue the loop
-      if ( device_ == NULL )
-        {
-          break;
-        }
+//
+// Publishes the image in the buffer and returns the buffer to the
+// pipeline. send_sample() copies the image into its message, so nothing
+// refers to the buffer after this returns.
+//
+void
+i3ds::CosineCamera::publishFrame ( PvBuffer *buffer )
+{
+  PvBuffer *lHeld = buffer;
+  PvImage *lImage = buffer->GetImage();
+  uint32_t lWidth = lImage->GetWidth();
+  uint32_t lHeight = lImage->GetHeight();
+  unsigned char *lData = lImage->GetDataPointer();
 
-      if ( ( mStream != NULL ) && mStream->IsOpen() && ( mPipeline != NULL )
-           && mPipeline->IsStarted() )
-        {
-          // Retrieve next buffer
-          PvBuffer *lBuffer = NULL;
-          PvResult lOperationResult;
+  FRAME_LOG ( debug ) << "Width: " << lWidth << " Height: " << lHeight;
 
+  FrameTiming timing;
 
-          PvResult lResult = mPipeline->RetrieveNextBuffer ( &lBuffer, timeout_, &lOperationResult );
+  timing.block_id = buffer->GetBlockID();
+  timing.device_timestamp = buffer->GetTimestamp();
+  timing.synchronized = clock_.toHost ( timing.device_timestamp, timing.host_time, timing.error );
 
-          if ( lResult.IsOK() )
-            {
-              if ( lOperationResult.IsOK() )
-                {
-                  //
-                  // We now have a valid buffer. This is where you would typically process the buffer.
-                  // -----------------------------------------------------------------------------------------
-                  // ...
+  if ( timing.synchronized )
+    {
+      timing.host_time += clock_epoch_;
+    }
+  else
+    {
+      timing.host_time = std::chrono::duration_cast<std::chrono::microseconds> (
+                           std::chrono::system_clock::now().time_since_epoch() ).count();
+      timing.error = 0.0;
+    }
 
-                  mStream->GetParameters()->GetIntegerValue ( "BlockCount", lImageCountVal );
-                  mStream->GetParameters()->GetFloatValue ( "AcquisitionRate", lFrameRateVal );
-                  mStream->GetParameters()->GetFloatValue ( "Bandwidth", lBandwidthVal );
+  if ( packed_format_ != PackedFormat::none )
+    {
+      // Unpack to 16-bit pixels, after which the buffer can go back. The
+      // image size may include padding, count the pixels from the geometry.
+      const size_t pixels = (size_t) lWidth * lHeight * param_.image_count;
 
-                  // If the buffer contains an image, display width and height.
+      if ( lImage->GetImageSize() < packed12_size ( pixels ) )
+        {
+          FRAME_LOG ( warning ) << "Packed image of " << lImage->GetImageSize() << " bytes too small for "
+                                << pixels << " pixels, dropped";
 
-                  if ( lBuffer->GetPayloadType() == PvPayloadTypeImage )
-                    {
-                      // Get image specific buffer interface.
-                      PvImage *lImage = lBuffer->GetImage();
-                      uint32_t lWidth = lImage->GetWidth();
-                      uint32_t lHeight = lImage->GetHeight();
+          mPipeline->ReleaseBuffer ( buffer );
+          return;
+        }
 
-                      BOOST_LOG_TRIVIAL ( info ) << "Width: " << lWidth << " Height: " << lHeight;
+      staging_.resize ( pixels * sizeof ( uint16_t ) );
+      uint16_t *lPixels = reinterpret_cast<uint16_t *> ( staging_.data() );
 
-                      send_sample ( lImage->GetDataPointer(), lWidth, lHeight );
-                    }
-                }
+      const PixelKernels& kernels = pixel_kernels();
 
-              // We have an image - do some processing (...) and VERY IMPORTANT,
-              // release the buffer back to the pipeline.
-              mPipeline->ReleaseBuffer ( lBuffer );
-            }
-          BOOST_LOG_TRIVIAL ( info ) << "sampling timeout without receiving good image: " << timeout_ << "ms";
+      if ( packed_format_ == PackedFormat::mono12packed )
+        {
+          kernels.unpack_mono12packed ( lData, lPixels, pixels );
         }
       else
         {
-          // No stream/pipeline, must be in recovery. Wait a bit...
-          PvSleepMs ( 100 );
-
+          kernels.unpack_mono12p ( lData, lPixels, pixels );
         }
+
+      lData = staging_.data();
+
+      mPipeline->ReleaseBuffer ( buffer );
+      lHeld = NULL;
     }
 
-  BOOST_LOG_TRIVIAL ( info ) << "--> Sampling Loop Exiting";
+  {
+    std::lock_guard<std::mutex> lock ( timing_mutex_ );
+    timing_ = timing;
+  }
+
+  if ( timing.synchronized )
+    {
+      // Stamp the sample with when it was taken, not when it is published.
+      send_sample ( lData, lWidth, lHeight, timing.host_time );
+    }
+  else
+    {
+      send_sample ( lData, lWidth, lHeight );
+    }
+
+  if ( lHeld != NULL )
+    {
+      mPipeline->ReleaseBuffer ( lHeld );
+    }
 }
@@ -0,0 +1,105 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "delay_tuner.hpp"
+
+#include <algorithm>
+
+i3ds::DelayTuner::DelayTuner()
+{
+  reset(0, 1, 0);
+}
+
+void
+i3ds::DelayTuner::reset(int64_t initial, int64_t step, int64_t max)
+{
+  step_ = std::max<int64_t>(step, 1);
+  max_ = std::max<int64_t>(max, 0);
+  delay_ = std::min(std::max<int64_t>(initial, 0), max_);
+  lossy_ = -1;
+  clean_ = -1;
+  settled_ = false;
+  clean_count_ = 0;
+  has_last_ = false;
+}
+
+bool
+i3ds::DelayTuner::update(const LossCounters& counters)
+{
+  if (!has_last_)
+    {
+      has_last_ = true;
+      last_ = counters;
+      return false;
+    }
+
+  const int64_t frames = counters.frames() - last_.frames();
+
+  // Packets lost on the wire, whether or not resend got them back.
+  const int64_t lost = (counters.missing_packets - last_.missing_packets)
+                       + (counters.recovered_packets - last_.recovered_packets)
+                       + (counters.lost() - last_.lost());
+
+  last_ = counters;
+
+  if (frames == 0)
+    {
+      return false;
+    }
+
+  const int64_t before = delay_;
+
+  if (lost > 0)
+    {
+      clean_count_ = 0;
+
+      if (settled_)
+        {
+          // Conditions changed, search upwards from here.
+          settled_ = false;
+          clean_ = -1;
+        }
+
+      lossy_ = delay_;
+
+      if (clean_ < 0)
+        {
+          delay_ = std::min(std::max(2 * delay_, delay_ + step_), max_);
+        }
+      else
+        {
+          delay_ = (lossy_ + clean_ + 1) / 2;
+        }
+
+      if (delay_ == before)
+        {
+          // Lossy even at the largest delay the frame rate allows.
+          settled_ = true;
+        }
+    }
+  else if (!settled_ && ++clean_count_ >= clean_samples)
+    {
+      clean_count_ = 0;
+      clean_ = delay_;
+
+      const int64_t floor = std::max<int64_t>(lossy_, 0);
+
+      if (clean_ - floor <= step_ || (lossy_ < 0 && clean_ == 0))
+        {
+          settled_ = true;
+        }
+      else
+        {
+          delay_ = (floor + clean_) / 2;
+        }
+    }
+
+  return delay_ != before;
+}
@@ -9,6 +9,7 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include <csignal>
+#include <cstdlib>
 #include <iostream>
 #include <unistd.h>
 #include <string>
@@ -25,6 +26,12 @@
 #include <boost/log/core.hpp>
 #include <boost/log/trivial.hpp>
 #include <boost/log/expressions.hpp>
+#include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/text_ostream_backend.hpp>
+#include <boost/log/support/date_time.hpp>
+#include <boost/log/utility/setup/common_attributes.hpp>
+#include <boost/core/null_deleter.hpp>
+#include <boost/make_shared.hpp>
 
 
 #include <cstddef>
@@ -34,9 +41,34 @@
 
 namespace po = boost::program_options;
 namespace logging = boost::log;
+namespace sinks = boost::log::sinks;
+namespace expr = boost::log::expressions;
+
+typedef sinks::asynchronous_sink<sinks::text_ostream_backend> AsyncSink;
 
 volatile bool running;
 
+// Formats and writes log records on a separate thread, so that logging
+// from the sampling threads only queues the record.
+boost::shared_ptr<AsyncSink> init_logging()
+{
+  boost::shared_ptr<sinks::text_ostream_backend> backend = boost::make_shared<sinks::text_ostream_backend>();
+  backend->add_stream(boost::shared_ptr<std::ostream>(&std::clog, boost::null_deleter()));
+  backend->auto_flush(true);
+
+  boost::shared_ptr<AsyncSink> sink = boost::make_shared<AsyncSink>(backend);
+
+  sink->set_formatter(expr::stream
+                      << "[" << expr::format_date_time<boost::posix_time::ptime>("TimeStamp", "%Y-%m-%d %H:%M:%S.%f")
+                      << "] [" << logging::trivial::severity
+                      << "] " << expr::smessage);
+
+  logging::add_common_attributes();
+  logging::core::get()->add_sink(sink);
+
+  return sink;
+}
+
 
 void signal_handler ( int signum )
 {
@@ -47,9 +79,14 @@ void signal_handler ( int signum )
 int main ( int argc, char **argv )
 {
   std::string camera_type;
+  std::string ring_overflow;
   unsigned int node_id;
   int trigger_scale;
   i3ds::GigECamera::Parameters param;
+  i3ds::CosineCamera::Options options;
+
+  const char* home = getenv("HOME");
+  const std::string address_cache = home ? std::string(home) + "/.cache/i3ds" : "/tmp/i3ds";
 
   po::options_description desc("Allowed camera control options");
 
@@ -77,6 +114,23 @@ int main ( int argc, char **argv )
   ("trigger-pattern-output", po::value<int>(&param.pattern_output)->default_value(6), "Trigger output for pattern.")
   ("trigger-pattern-offset", po::value<int>(&param.pattern_offset)->default_value(0), "Trigger offset for pattern (us).")
 
+  ("ring-size", po::value<int>(&options.ring_size)->default_value(8), "Frames queued between acquisition and publishing.")
+  ("ring-overflow", po::value<std::string>(&ring_overflow)->default_value("drop-oldest"),
+   "Policy when publishing falls behind {drop-oldest, drop-newest, block}.")
+  ("buffer-count", po::value<int>(&options.buffer_count)->default_value(0), "Pipeline buffers, 0 to size from budget.")
+  ("buffer-budget", po::value<int64_t>(&options.buffer_budget)->default_value(128), "Pipeline buffer memory budget (MiB).")
+  ("stats-period", po::value<int>(&options.stats_period)->default_value(1000), "Stream statistics sample period (ms).")
+  ("packed-pixels", po::value<bool>(&options.packed_pixels)->default_value(true), "Use packed 12-bit pixels on the link.")
+  ("auto-transport", po::value<bool>(&options.auto_transport)->default_value(false), "Negotiate packet size and tune packet delay.")
+  ("link-group", po::value<std::string>(&options.link_group)->default_value(""), "Host link shared with other camera nodes.")
+  ("address-cache", po::value<std::string>(&options.address_cache)->default_value(address_cache),
+   "Directory caching the camera address between runs, empty to always discover.")
+  ("warm-stream", po::value<bool>(&options.warm_stream)->default_value(false),
+   "Keep stream and pipeline open between stop and start.")
+  ("command-timeout", po::value<int>(&options.command_timeout)->default_value(100),
+   "Time a parameter write is waited for before the command returns (ms).")
+  ("resend-latency", po::value<int>(&options.resend_latency)->default_value(50), "Latency bound for packet resend (ms), 0 disables resend.")
+
   ("verbose,v", "Print verbose output")
   ("quiet,q", "Quiet output")
   ("print,p", "Print the camera configuration")
@@ -91,7 +145,9 @@ int main ( int argc, char **argv )
       return -1;
     }
 
-  if (vm.count("quite"))
+  boost::shared_ptr<AsyncSink> log_sink = init_logging();
+
+  if (vm.count("quiet"))
     {
       logging::core::get()->set_filter(logging::trivial::severity >= logging::trivial::warning);
     }
@@ -102,6 +158,9 @@ int main ( int argc, char **argv )
 
   po::notify(vm);
 
+  options.packet_size_given = !vm["package-size"].defaulted();
+  options.packet_delay_given = !vm["package-delay"].defaulted();
+
 
   BOOST_LOG_TRIVIAL ( info ) << "Node ID:     " << node_id;
   BOOST_LOG_TRIVIAL ( info ) << "Camera name: " << param.camera_name;
@@ -136,11 +195,54 @@ int main ( int argc, char **argv )
       return -1;
     }
 
+  if ( ring_overflow == "drop-oldest" )
+    {
+      options.overflow = i3ds::OverflowPolicy::drop_oldest;
+    }
+  else if ( ring_overflow == "drop-newest" )
+    {
+      options.overflow = i3ds::OverflowPolicy::drop_newest;
+    }
+  else if ( ring_overflow == "block" )
+    {
+      options.overflow = i3ds::OverflowPolicy::block;
+    }
+  else
+    {
+      BOOST_LOG_TRIVIAL ( error ) << "Unknown ring overflow policy: " << ring_overflow << std::endl;
+      return -1;
+    }
+
+  if ( options.ring_size < 1 || options.ring_size > (int) i3ds::FrameRing<void*>::max_capacity )
+    {
+      BOOST_LOG_TRIVIAL ( error ) << "Ring size must be in [1, " << i3ds::FrameRing<void*>::max_capacity
+                                  << "]: " << options.ring_size << std::endl;
+      return -1;
+    }
+
+  if ( options.stats_period < 1 )
+    {
+      BOOST_LOG_TRIVIAL ( error ) << "Statistics period must be at least 1 ms: " << options.stats_period << std::endl;
+      return -1;
+    }
+
+  if ( options.buffer_count < 0 )
+    {
+      BOOST_LOG_TRIVIAL ( error ) << "Buffer count must not be negative: " << options.buffer_count << std::endl;
+      return -1;
+    }
+
+  if ( options.buffer_budget < 1 )
+    {
+      BOOST_LOG_TRIVIAL ( error ) << "Buffer budget must be at least 1 MiB: " << options.buffer_budget << std::endl;
+      return -1;
+    }
+
   i3ds::Context::Ptr context = i3ds::Context::Create();;
 
   i3ds::Server server ( context );
 
-  i3ds::CosineCamera camera ( context, node_id, param, trigger_scale);
+  i3ds::CosineCamera camera ( context, node_id, param, trigger_scale, options );
 
   camera.Attach ( server );
 
@@ -156,5 +258,9 @@ int main ( int argc, char **argv )
 
   server.Stop();
 
+  logging::core::get()->remove_sink(log_sink);
+  log_sink->stop();
+  log_sink->flush();
+
   return 0;
 }
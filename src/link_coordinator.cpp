@@ -0,0 +1,314 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "link_coordinator.hpp"
+#include "bandwidth_model.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Identifies a table of this layout.
+static const uint32_t LINK_MAGIC = 0x4C4E4B31;
+
+static const int MAX_STREAMS = 16;
+
+struct i3ds::LinkCoordinator::Link
+{
+  std::atomic<uint32_t> magic;
+
+  pthread_mutex_t mutex;
+
+  // Bumped whenever the division changes.
+  uint64_t generation;
+
+  struct Stream
+  {
+    pid_t pid;
+    double demand;
+    double capacity;
+    double share;
+  };
+
+  Stream streams[MAX_STREAMS];
+};
+
+// Holds the table mutex, recovering it if the previous owner died.
+class i3ds::LinkCoordinator::Lock
+{
+public:
+
+  explicit Lock(LinkCoordinator& coordinator)
+    : mutex_(&coordinator.link_->mutex)
+  {
+    if (pthread_mutex_lock(mutex_) == EOWNERDEAD)
+      {
+        pthread_mutex_consistent(mutex_);
+        coordinator.purge();
+      }
+  }
+
+  ~Lock()
+  {
+    pthread_mutex_unlock(mutex_);
+  }
+
+private:
+
+  pthread_mutex_t* mutex_;
+};
+
+i3ds::LinkCoordinator::LinkCoordinator()
+  : link_(NULL),
+    slot_(-1),
+    generation_(0)
+{
+}
+
+i3ds::LinkCoordinator::~LinkCoordinator()
+{
+  close();
+}
+
+bool
+i3ds::LinkCoordinator::open(const std::string& name)
+{
+  close();
+
+  const std::string path = "/" + name;
+
+  int fd = shm_open(path.c_str(), O_RDWR | O_CREAT, 0666);
+
+  if (fd < 0)
+    {
+      return false;
+    }
+
+  // The table is created under a lock on the file rather than the table
+  // mutex, which is not usable until it is initialised. The kernel drops
+  // the lock of a process that dies, so a table left half made by a dead
+  // creator is seen without magic and made again by the next opener.
+  if (flock(fd, LOCK_EX) != 0)
+    {
+      ::close(fd);
+      return false;
+    }
+
+  struct stat st;
+
+  if (fstat(fd, &st) != 0 || (st.st_size < (off_t) sizeof(Link) && ftruncate(fd, sizeof(Link)) != 0))
+    {
+      ::close(fd);
+      return false;
+    }
+
+  void* memory = mmap(NULL, sizeof(Link), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  if (memory == MAP_FAILED)
+    {
+      ::close(fd);
+      return false;
+    }
+
+  Link* link = static_cast<Link*>(memory);
+
+  if (link->magic.load(std::memory_order_acquire) != LINK_MAGIC)
+    {
+      pthread_mutexattr_t attr;
+
+      pthread_mutexattr_init(&attr);
+      pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+      pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+      pthread_mutex_init(&link->mutex, &attr);
+      pthread_mutexattr_destroy(&attr);
+
+      link->generation = 0;
+
+      for (Link::Stream& s : link->streams)
+        {
+          s.pid = 0;
+        }
+
+      link->magic.store(LINK_MAGIC, std::memory_order_release);
+    }
+
+  // The mapping keeps the file open, so the lock must be dropped by hand.
+  flock(fd, LOCK_UN);
+  ::close(fd);
+
+  link_ = link;
+  generation_ = 0;
+
+  return true;
+}
+
+void
+i3ds::LinkCoordinator::close()
+{
+  if (link_ == NULL)
+    {
+      return;
+    }
+
+  leave();
+
+  munmap(link_, sizeof(Link));
+  link_ = NULL;
+}
+
+bool
+i3ds::LinkCoordinator::join(double demand, double capacity)
+{
+  if (link_ == NULL)
+    {
+      return false;
+    }
+
+  Lock lock(*this);
+
+  if (slot_ < 0)
+    {
+      purge();
+
+      for (int i = 0; i < MAX_STREAMS && slot_ < 0; i++)
+        {
+          if (link_->streams[i].pid == 0)
+            {
+              slot_ = i;
+            }
+        }
+
+      if (slot_ < 0)
+        {
+          return false;
+        }
+    }
+
+  Link::Stream& s = link_->streams[slot_];
+
+  s.pid = getpid();
+  s.demand = demand;
+  s.capacity = capacity;
+
+  divide();
+
+  return true;
+}
+
+void
+i3ds::LinkCoordinator::leave()
+{
+  if (link_ == NULL || slot_ < 0)
+    {
+      return;
+    }
+
+  Lock lock(*this);
+
+  link_->streams[slot_].pid = 0;
+  slot_ = -1;
+
+  divide();
+}
+
+bool
+i3ds::LinkCoordinator::update(double& share, int& streams)
+{
+  if (link_ == NULL || slot_ < 0)
+    {
+      return false;
+    }
+
+  Lock lock(*this);
+
+  // Processes that die do not leave, notice them here.
+  purge();
+
+  if (link_->generation == generation_)
+    {
+      return false;
+    }
+
+  generation_ = link_->generation;
+
+  share = link_->streams[slot_].share;
+  streams = 0;
+
+  for (const Link::Stream& s : link_->streams)
+    {
+      streams += s.pid != 0;
+    }
+
+  return true;
+}
+
+//
+// Shares the usable capacity of the slowest registered link in proportion
+// to demand. Called with the mutex held.
+//
+void
+i3ds::LinkCoordinator::divide()
+{
+  double demand = 0.0;
+  double capacity = 0.0;
+
+  for (const Link::Stream& s : link_->streams)
+    {
+      if (s.pid != 0)
+        {
+          demand += s.demand;
+          capacity = capacity > 0.0 ? std::min(capacity, s.capacity) : s.capacity;
+        }
+    }
+
+  capacity *= BandwidthModel::max_utilization;
+
+  for (Link::Stream& s : link_->streams)
+    {
+      if (s.pid != 0)
+        {
+          s.share = demand > 0.0 ? capacity * s.demand / demand : capacity;
+        }
+    }
+
+  link_->generation++;
+}
+
+//
+// Removes streams of processes that no longer exist. Called with the
+// mutex held.
+//
+void
+i3ds::LinkCoordinator::purge()
+{
+  bool removed = false;
+
+  for (Link::Stream& s : link_->streams)
+    {
+      if (s.pid != 0 && kill(s.pid, 0) != 0 && errno == ESRCH)
+        {
+          s.pid = 0;
+          removed = true;
+        }
+    }
+
+  if (removed)
+    {
+      divide();
+    }
+}
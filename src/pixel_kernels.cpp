@@ -0,0 +1,592 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "pixel_kernels.hpp"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PIXEL_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define PIXEL_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Scalar reference kernels
+////////////////////////////////////////////////////////////////////////////////
+
+static void
+scalar_unpack_mono12packed(const uint8_t* src, uint16_t* dst, size_t pixels)
+{
+  size_t i = 0;
+
+  for (; i + 1 < pixels; i += 2, src += 3)
+    {
+      dst[i] = (uint16_t) ((src[0] << 4) | (src[1] & 0x0F));
+      dst[i + 1] = (uint16_t) ((src[2] << 4) | (src[1] >> 4));
+    }
+
+  if (i < pixels)
+    {
+      dst[i] = (uint16_t) ((src[0] << 4) | (src[1] & 0x0F));
+    }
+}
+
+static void
+scalar_unpack_mono12p(const uint8_t* src, uint16_t* dst, size_t pixels)
+{
+  size_t i = 0;
+
+  for (; i + 1 < pixels; i += 2, src += 3)
+    {
+      dst[i] = (uint16_t) (src[0] | ((src[1] & 0x0F) << 8));
+      dst[i + 1] = (uint16_t) ((src[1] >> 4) | (src[2] << 4));
+    }
+
+  if (i < pixels)
+    {
+      dst[i] = (uint16_t) (src[0] | ((src[1] & 0x0F) << 8));
+    }
+}
+
+static void
+scalar_shift_to_8(const uint16_t* src, uint8_t* dst, size_t pixels, int shift)
+{
+  for (size_t i = 0; i < pixels; i++)
+    {
+      dst[i] = (uint8_t) std::min(src[i] >> shift, 255);
+    }
+}
+
+// The window is applied in 16.16 fixed point, identical in all kernels.
+static uint32_t
+window_scale(uint16_t low, uint16_t high)
+{
+  return (255u << 16) / std::max(high - low, 1);
+}
+
+static void
+scalar_window_to_8(const uint16_t* src, uint8_t* dst, size_t pixels, uint16_t low, uint16_t high)
+{
+  const uint32_t range = std::max(high - low, 1);
+  const uint32_t scale = window_scale(low, high);
+
+  for (size_t i = 0; i < pixels; i++)
+    {
+      const uint32_t d = std::min<uint32_t>(src[i] > low ? src[i] - low : 0, range);
+      dst[i] = (uint8_t) ((d * scale) >> 16);
+    }
+}
+
+static void
+scalar_align_msb(const uint16_t* src, uint16_t* dst, size_t pixels, int depth)
+{
+  for (size_t i = 0; i < pixels; i++)
+    {
+      dst[i] = (uint16_t) (src[i] << (16 - depth));
+    }
+}
+
+static void
+scalar_align_lsb(const uint16_t* src, uint16_t* dst, size_t pixels, int depth)
+{
+  for (size_t i = 0; i < pixels; i++)
+    {
+      dst[i] = (uint16_t) (src[i] >> (16 - depth));
+    }
+}
+
+static const i3ds::PixelKernels scalar_kernels =
+{
+  "scalar",
+  scalar_unpack_mono12packed,
+  scalar_unpack_mono12p,
+  scalar_shift_to_8,
+  scalar_window_to_8,
+  scalar_align_msb,
+  scalar_align_lsb
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// x86 SSE4.1 and AVX2 kernels
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef PIXEL_KERNELS_X86
+
+// Spreads four 3-byte groups in the low 12 bytes over eight 16-bit lanes.
+// Mono12Packed takes bytes (b0, b1) and (b2, b1), Mono12p (b0, b1) and
+// (b1, b2).
+#define SHUFFLE_MONO12PACKED 0, 1, 2, 1, 3, 4, 5, 4, 6, 7, 8, 7, 9, 10, 11, 10
+#define SHUFFLE_MONO12P      0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11
+
+#define EVEN_LANES(x) x, 0, x, 0, x, 0, x, 0
+#define ODD_LANES(x)  0, x, 0, x, 0, x, 0, x
+
+__attribute__((target("sse4.1")))
+static inline __m128i
+sse_mono12packed(__m128i v)
+{
+  const __m128i spread = _mm_shuffle_epi8(v, _mm_setr_epi8(SHUFFLE_MONO12PACKED));
+  const __m128i high = _mm_and_si128(_mm_slli_epi16(spread, 4), _mm_set1_epi16(0x0FF0));
+  const __m128i even = _mm_and_si128(_mm_srli_epi16(spread, 8), _mm_setr_epi16(EVEN_LANES(0x000F)));
+  const __m128i odd = _mm_and_si128(_mm_srli_epi16(spread, 12), _mm_setr_epi16(ODD_LANES(0x000F)));
+
+  return _mm_or_si128(high, _mm_or_si128(even, odd));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i
+sse_mono12p(__m128i v)
+{
+  const __m128i spread = _mm_shuffle_epi8(v, _mm_setr_epi8(SHUFFLE_MONO12P));
+  const __m128i even = _mm_and_si128(spread, _mm_setr_epi16(EVEN_LANES(0x0FFF)));
+  const __m128i odd = _mm_and_si128(_mm_srli_epi16(spread, 4), _mm_setr_epi16(ODD_LANES(0x0FFF)));
+
+  return _mm_or_si128(even, odd);
+}
+
+__attribute__((target("sse4.1")))
+static void
+sse_unpack_mono12packed(const uint8_t* src, uint16_t* dst, size_t pixels)
+{
+  size_t i = 0;
+
+  // Eight pixels from twelve bytes, loading sixteen.
+  for (; i + 16 <= pixels; i += 8)
+    {
+      const __m128i v = _mm_loadu_si128((const __m128i*) (src + i / 2 * 3));
+      _mm_storeu_si128((__m128i*) (dst + i), sse_mono12packed(v));
+    }
+
+  scalar_unpack_mono12packed(src + i / 2 * 3, dst + i, pixels - i);
+}
+
+__attribute__((target("sse4.1")))
+static void
+sse_unpack_mono12p(const uint8_t* src, uint16_t* dst, size_t pixels)
+{
+  size_t i = 0;
+
+  for (; i + 16 <= pixels; i += 8)
+    {
+      const __m128i v = _mm_loadu_si128((const __m128i*) (src + i / 2 * 3));
+      _mm_storeu_si128((__m128i*) (dst + i), sse_mono12p(v));
+    }
+
+  scalar_unpack_mono12p(src + i / 2 * 3, dst + i, pixels - i);
+}
+
+__attribute__((target("sse4.1")))
+static void
+sse_shift_to_8(const uint16_t* src, uint8_t* dst, size_t pixels, int shift)
+{
+  const __m128i count = _mm_cvtsi32_si128(shift);
+  const __m128i max = _mm_set1_epi16(255);
+
+  size_t i = 0;
+
+  for (; i + 16 <= pixels; i += 16)
+    {
+      __m128i a = _mm_loadu_si128((const __m128i*) (src + i));
+      __m128i b = _mm_loadu_si128((const __m128i*) (src + i + 8));
+
+      a = _mm_min_epu16(_mm_srl_epi16(a, count), max);
+      b = _mm_min_epu16(_mm_srl_epi16(b, count), max);
+
+      _mm_storeu_si128((__m128i*) (dst + i), _mm_packus_epi16(a, b));
+    }
+
+  scalar_shift_to_8(src + i, dst + i, pixels - i, shift);
+}
+
+__attribute__((target("sse4.1")))
+static void
+sse_window_to_8(const uint16_t* src, uint8_t* dst, size_t pixels, uint16_t low, uint16_t high)
+{
+  const __m128i vlow = _mm_set1_epi16((short) low);
+  const __m128i vrange = _mm_set1_epi16((short) std::max(high - low, 1));
+  const __m128i vscale = _mm_set1_epi32((int) window_scale(low, high));
+  const __m128i zero = _mm_setzero_si128();
+
+  size_t i = 0;
+
+  for (; i + 8 <= pixels; i += 8)
+    {
+      __m128i d = _mm_loadu_si128((const __m128i*) (src + i));
+      d = _mm_min_epu16(_mm_subs_epu16(d, vlow), vrange);
+
+      __m128i lo = _mm_unpacklo_epi16(d, zero);
+      __m128i hi = _mm_unpackhi_epi16(d, zero);
+
+      lo = _mm_srli_epi32(_mm_mullo_epi32(lo, vscale), 16);
+      hi = _mm_srli_epi32(_mm_mullo_epi32(hi, vscale), 16);
+
+      const __m128i out = _mm_packus_epi16(_mm_packus_epi32(lo, hi), zero);
+      _mm_storel_epi64((__m128i*) (dst + i), out);
+    }
+
+  scalar_window_to_8(src + i, dst + i, pixels - i, low, high);
+}
+
+__attribute__((target("sse4.1")))
+static void
+sse_align_msb(const uint16_t* src, uint16_t* dst, size_t pixels, int depth)
+{
+  const __m128i count = _mm_cvtsi32_si128(16 - depth);
+
+  size_t i = 0;
+
+  for (; i + 8 <= pixels; i += 8)
+    {
+      const __m128i v = _mm_loadu_si128((const __m128i*) (src + i));
+      _mm_storeu_si128((__m128i*) (dst + i), _mm_sll_epi16(v, count));
+    }
+
+  scalar_align_msb(src + i, dst + i, pixels - i, depth);
+}
+
+__attribute__((target("sse4.1")))
+static void
+sse_align_lsb(const uint16_t* src, uint16_t* dst, size_t pixels, int depth)
+{
+  const __m128i count = _mm_cvtsi32_si128(16 - depth);
+
+  size_t i = 0;
+
+  for (; i + 8 <= pixels; i += 8)
+    {
+      const __m128i v = _mm_loadu_si128((const __m128i*) (src + i));
+      _mm_storeu_si128((__m128i*) (dst + i), _mm_srl_epi16(v, count));
+    }
+
+  scalar_align_lsb(src + i, dst + i, pixels - i, depth);
+}
+
+static const i3ds::PixelKernels sse41_kernels =
+{
+  "sse4.1",
+  sse_unpack_mono12packed,
+  sse_unpack_mono12p,
+  sse_shift_to_8,
+  sse_window_to_8,
+  sse_align_msb,
+  sse_align_lsb
+};
+
+// Loads twelve bytes from each of src and src + 12 into the two halves.
+__attribute__((target("avx2")))
+static inline __m256i
+avx2_load_groups(const uint8_t* src)
+{
+  const __m128i lo = _mm_loadu_si128((const __m128i*) src);
+  const __m128i hi = _mm_loadu_si128((const __m128i*) (src + 12));
+
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+__attribute__((target("avx2")))
+static void
+avx2_unpack_mono12packed(const uint8_t* src, uint16_t* dst, size_t pixels)
+{
+  const __m256i shuffle = _mm256_setr_epi8(SHUFFLE_MONO12PACKED, SHUFFLE_MONO12PACKED);
+  const __m256i high_mask = _mm256_set1_epi16(0x0FF0);
+  const __m256i even_mask = _mm256_setr_epi16(EVEN_LANES(0x000F), EVEN_LANES(0x000F));
+  const __m256i odd_mask = _mm256_setr_epi16(ODD_LANES(0x000F), ODD_LANES(0x000F));
+
+  size_t i = 0;
+
+  // Sixteen pixels from 24 bytes, loading 28.
+  for (; i + 24 <= pixels; i += 16)
+    {
+      const __m256i spread = _mm256_shuffle_epi8(avx2_load_groups(src + i / 2 * 3), shuffle);
+      const __m256i high = _mm256_and_si256(_mm256_slli_epi16(spread, 4), high_mask);
+      const __m256i even = _mm256_and_si256(_mm256_srli_epi16(spread, 8), even_mask);
+      const __m256i odd = _mm256_and_si256(_mm256_srli_epi16(spread, 12), odd_mask);
+
+      _mm256_storeu_si256((__m256i*) (dst + i), _mm256_or_si256(high, _mm256_or_si256(even, odd)));
+    }
+
+  sse_unpack_mono12packed(src + i / 2 * 3, dst + i, pixels - i);
+}
+
+__attribute__((target("avx2")))
+static void
+avx2_unpack_mono12p(const uint8_t* src, uint16_t* dst, size_t pixels)
+{
+  const __m256i shuffle = _mm256_setr_epi8(SHUFFLE_MONO12P, SHUFFLE_MONO12P);
+  const __m256i even_mask = _mm256_setr_epi16(EVEN_LANES(0x0FFF), EVEN_LANES(0x0FFF));
+  const __m256i odd_mask = _mm256_setr_epi16(ODD_LANES(0x0FFF), ODD_LANES(0x0FFF));
+
+  size_t i = 0;
+
+  for (; i + 24 <= pixels; i += 16)
+    {
+      const __m256i spread = _mm256_shuffle_epi8(avx2_load_groups(src + i / 2 * 3), shuffle);
+      const __m256i even = _mm256_and_si256(spread, even_mask);
+      const __m256i odd = _mm256_and_si256(_mm256_srli_epi16(spread, 4), odd_mask);
+
+      _mm256_storeu_si256((__m256i*) (dst + i), _mm256_or_si256(even, odd));
+    }
+
+  sse_unpack_mono12p(src + i / 2 * 3, dst + i, pixels - i);
+}
+
+__attribute__((target("avx2")))
+static void
+avx2_shift_to_8(const uint16_t* src, uint8_t* dst, size_t pixels, int shift)
+{
+  const __m128i count = _mm_cvtsi32_si128(shift);
+  const __m256i max = _mm256_set1_epi16(255);
+
+  size_t i = 0;
+
+  for (; i + 32 <= pixels; i += 32)
+    {
+      __m256i a = _mm256_loadu_si256((const __m256i*) (src + i));
+      __m256i b = _mm256_loadu_si256((const __m256i*) (src + i + 16));
+
+      a = _mm256_min_epu16(_mm256_srl_epi16(a, count), max);
+      b = _mm256_min_epu16(_mm256_srl_epi16(b, count), max);
+
+      // Packing works per 128-bit lane, put the quarters back in order.
+      const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+      _mm256_storeu_si256((__m256i*) (dst + i), packed);
+    }
+
+  sse_shift_to_8(src + i, dst + i, pixels - i, shift);
+}
+
+__attribute__((target("avx2")))
+static void
+avx2_align_msb(const uint16_t* src, uint16_t* dst, size_t pixels, int depth)
+{
+  const __m128i count = _mm_cvtsi32_si128(16 - depth);
+
+  size_t i = 0;
+
+  for (; i + 16 <= pixels; i += 16)
+    {
+      const __m256i v = _mm256_loadu_si256((const __m256i*) (src + i));
+      _mm256_storeu_si256((__m256i*) (dst + i), _mm256_sll_epi16(v, count));
+    }
+
+  sse_align_msb(src + i, dst + i, pixels - i, depth);
+}
+
+__attribute__((target("avx2")))
+static void
+avx2_align_lsb(const uint16_t* src, uint16_t* dst, size_t pixels, int depth)
+{
+  const __m128i count = _mm_cvtsi32_si128(16 - depth);
+
+  size_t i = 0;
+
+  for (; i + 16 <= pixels; i += 16)
+    {
+      const __m256i v = _mm256_loadu_si256((const __m256i*) (src + i));
+      _mm256_storeu_si256((__m256i*) (dst + i), _mm256_srl_epi16(v, count));
+    }
+
+  sse_align_lsb(src + i, dst + i, pixels - i, depth);
+}
+
+// The window kernel needs 32-bit products, the SSE4.1 one is as fast.
+static const i3ds::PixelKernels avx2_kernels =
+{
+  "avx2",
+  avx2_unpack_mono12packed,
+  avx2_unpack_mono12p,
+  avx2_shift_to_8,
+  sse_window_to_8,
+  avx2_align_msb,
+  avx2_align_lsb
+};
+
+#endif // PIXEL_KERNELS_X86
+
+////////////////////////////////////////////////////////////////////////////////
+// aarch64 NEON kernels
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef PIXEL_KERNELS_NEON
+
+static void
+neon_unpack_mono12packed(const uint8_t* src, uint16_t* dst, size_t pixels)
+{
+  const uint8x8_t nibble = vdup_n_u8(0x0F);
+
+  size_t i = 0;
+
+  // Sixteen pixels from 24 bytes, split into first, middle and last bytes.
+  for (; i + 16 <= pixels; i += 16)
+    {
+      const uint8x8x3_t b = vld3_u8(src + i / 2 * 3);
+      uint16x8x2_t p;
+
+      p.val[0] = vorrq_u16(vshll_n_u8(b.val[0], 4), vmovl_u8(vand_u8(b.val[1], nibble)));
+      p.val[1] = vorrq_u16(vshll_n_u8(b.val[2], 4), vmovl_u8(vshr_n_u8(b.val[1], 4)));
+
+      vst2q_u16(dst + i, p);
+    }
+
+  scalar_unpack_mono12packed(src + i / 2 * 3, dst + i, pixels - i);
+}
+
+static void
+neon_unpack_mono12p(const uint8_t* src, uint16_t* dst, size_t pixels)
+{
+  const uint8x8_t nibble = vdup_n_u8(0x0F);
+
+  size_t i = 0;
+
+  for (; i + 16 <= pixels; i += 16)
+    {
+      const uint8x8x3_t b = vld3_u8(src + i / 2 * 3);
+      uint16x8x2_t p;
+
+      p.val[0] = vorrq_u16(vmovl_u8(b.val[0]), vshll_n_u8(vand_u8(b.val[1], nibble), 8));
+      p.val[1] = vorrq_u16(vmovl_u8(vshr_n_u8(b.val[1], 4)), vshll_n_u8(b.val[2], 4));
+
+      vst2q_u16(dst + i, p);
+    }
+
+  scalar_unpack_mono12p(src + i / 2 * 3, dst + i, pixels - i);
+}
+
+static void
+neon_shift_to_8(const uint16_t* src, uint8_t* dst, size_t pixels, int shift)
+{
+  const int16x8_t count = vdupq_n_s16((int16_t) -shift);
+
+  size_t i = 0;
+
+  for (; i + 16 <= pixels; i += 16)
+    {
+      const uint16x8_t a = vshlq_u16(vld1q_u16(src + i), count);
+      const uint16x8_t b = vshlq_u16(vld1q_u16(src + i + 8), count);
+
+      vst1q_u8(dst + i, vcombine_u8(vqmovn_u16(a), vqmovn_u16(b)));
+    }
+
+  scalar_shift_to_8(src + i, dst + i, pixels - i, shift);
+}
+
+static void
+neon_window_to_8(const uint16_t* src, uint8_t* dst, size_t pixels, uint16_t low, uint16_t high)
+{
+  const uint16x8_t vlow = vdupq_n_u16(low);
+  const uint16x8_t vrange = vdupq_n_u16((uint16_t) std::max(high - low, 1));
+  const uint32x4_t vscale = vdupq_n_u32(window_scale(low, high));
+
+  size_t i = 0;
+
+  for (; i + 8 <= pixels; i += 8)
+    {
+      const uint16x8_t d = vminq_u16(vqsubq_u16(vld1q_u16(src + i), vlow), vrange);
+
+      const uint32x4_t lo = vshrq_n_u32(vmulq_u32(vmovl_u16(vget_low_u16(d)), vscale), 16);
+      const uint32x4_t hi = vshrq_n_u32(vmulq_u32(vmovl_u16(vget_high_u16(d)), vscale), 16);
+
+      vst1_u8(dst + i, vqmovn_u16(vcombine_u16(vmovn_u32(lo), vmovn_u32(hi))));
+    }
+
+  scalar_window_to_8(src + i, dst + i, pixels - i, low, high);
+}
+
+static void
+neon_align_msb(const uint16_t* src, uint16_t* dst, size_t pixels, int depth)
+{
+  const int16x8_t count = vdupq_n_s16((int16_t) (16 - depth));
+
+  size_t i = 0;
+
+  for (; i + 8 <= pixels; i += 8)
+    {
+      vst1q_u16(dst + i, vshlq_u16(vld1q_u16(src + i), count));
+    }
+
+  scalar_align_msb(src + i, dst + i, pixels - i, depth);
+}
+
+static void
+neon_align_lsb(const uint16_t* src, uint16_t* dst, size_t pixels, int depth)
+{
+  const int16x8_t count = vdupq_n_s16((int16_t) (depth - 16));
+
+  size_t i = 0;
+
+  for (; i + 8 <= pixels; i += 8)
+    {
+      vst1q_u16(dst + i, vshlq_u16(vld1q_u16(src + i), count));
+    }
+
+  scalar_align_lsb(src + i, dst + i, pixels - i, depth);
+}
+
+static const i3ds::PixelKernels neon_kernels =
+{
+  "neon",
+  neon_unpack_mono12packed,
+  neon_unpack_mono12p,
+  neon_shift_to_8,
+  neon_window_to_8,
+  neon_align_msb,
+  neon_align_lsb
+};
+
+#endif // PIXEL_KERNELS_NEON
+
+////////////////////////////////////////////////////////////////////////////////
+// Dispatch
+////////////////////////////////////////////////////////////////////////////////
+
+std::vector<const i3ds::PixelKernels*>
+i3ds::supported_pixel_kernels()
+{
+  std::vector<const PixelKernels*> kernels = {&scalar_kernels};
+
+#ifdef PIXEL_KERNELS_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("sse4.1"))
+    {
+      kernels.push_back(&sse41_kernels);
+    }
+
+  if (__builtin_cpu_supports("avx2"))
+    {
+      kernels.push_back(&avx2_kernels);
+    }
+#endif
+
+#ifdef PIXEL_KERNELS_NEON
+  // NEON is part of the aarch64 base instruction set.
+  kernels.push_back(&neon_kernels);
+#endif
+
+  return kernels;
+}
+
+const i3ds::PixelKernels&
+i3ds::scalar_pixel_kernels()
+{
+  return scalar_kernels;
+}
+
+const i3ds::PixelKernels&
+i3ds::pixel_kernels()
+{
+  static const PixelKernels& best = *supported_pixel_kernels().back();
+  return best;
+}
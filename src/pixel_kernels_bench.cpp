@@ -0,0 +1,185 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+// Microbenchmark for the pixel kernels, timing each kernel set this CPU
+// supports on a full HR frame. Correctness against the scalar reference is
+// covered by test/test_pixel_kernels.cpp; the check here only guards the
+// numbers against a broken build.
+
+#include "pixel_kernels.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+using namespace i3ds;
+
+namespace
+{
+
+// Benchmark body running one kernel set over the test image. Returns the
+// number of input bytes processed.
+typedef std::function<size_t(const PixelKernels&)> Body;
+
+struct Buffers
+{
+  explicit Buffers(size_t pixels)
+    : packed(packed12_size(pixels) + 16),
+      wide(pixels),
+      out16(pixels),
+      out8(pixels),
+      n(pixels)
+  {
+    std::mt19937 random(42);
+
+    for (auto& b : packed)
+      {
+        b = (uint8_t) random();
+      }
+
+    for (auto& p : wide)
+      {
+        p = (uint16_t) (random() & 0x0FFF);
+      }
+  }
+
+  std::vector<uint8_t> packed;
+  std::vector<uint16_t> wide;
+  std::vector<uint16_t> out16;
+  std::vector<uint8_t> out8;
+  size_t n;
+};
+
+double
+seconds_per_run(const Body& body, const PixelKernels& kernels, int runs)
+{
+  body(kernels);
+
+  const auto start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < runs; i++)
+    {
+      body(kernels);
+    }
+
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  return elapsed.count() / runs;
+}
+
+void
+clear_outputs(Buffers& buffers)
+{
+  std::fill(buffers.out16.begin(), buffers.out16.end(), 0xDEAD);
+  std::fill(buffers.out8.begin(), buffers.out8.end(), 0xAD);
+}
+
+// Runs the body with both kernel sets and compares the outputs.
+bool
+matches_scalar(const Body& body, const PixelKernels& kernels, Buffers& buffers)
+{
+  clear_outputs(buffers);
+  body(scalar_pixel_kernels());
+
+  const std::vector<uint16_t> ref16 = buffers.out16;
+  const std::vector<uint8_t> ref8 = buffers.out8;
+
+  clear_outputs(buffers);
+  body(kernels);
+
+  return ref16 == buffers.out16 && ref8 == buffers.out8;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  // 2048 x 2048 by default, one odd pixel to exercise the tails.
+  const size_t pixels = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 2048 * 2048 + 1;
+  const int runs = argc > 2 ? std::atoi(argv[2]) : 50;
+
+  Buffers b(pixels);
+
+  struct Case
+  {
+    const char* name;
+    Body body;
+  };
+
+  const std::vector<Case> cases =
+  {
+    {"unpack_mono12packed", [&](const PixelKernels& k)
+      {
+        k.unpack_mono12packed(b.packed.data(), b.out16.data(), b.n);
+        return packed12_size(b.n);
+      }
+    },
+    {"unpack_mono12p", [&](const PixelKernels& k)
+      {
+        k.unpack_mono12p(b.packed.data(), b.out16.data(), b.n);
+        return packed12_size(b.n);
+      }
+    },
+    {"shift_to_8", [&](const PixelKernels& k)
+      {
+        k.shift_to_8(b.wide.data(), b.out8.data(), b.n, 3);
+        return b.n * sizeof(uint16_t);
+      }
+    },
+    {"window_to_8", [&](const PixelKernels& k)
+      {
+        k.window_to_8(b.wide.data(), b.out8.data(), b.n, 300, 3000);
+        return b.n * sizeof(uint16_t);
+      }
+    },
+    {"align_msb", [&](const PixelKernels& k)
+      {
+        k.align_msb(b.wide.data(), b.out16.data(), b.n, 12);
+        return b.n * sizeof(uint16_t);
+      }
+    },
+    {"align_lsb", [&](const PixelKernels& k)
+      {
+        k.align_lsb(b.wide.data(), b.out16.data(), b.n, 12);
+        return b.n * sizeof(uint16_t);
+      }
+    }
+  };
+
+  const std::vector<const PixelKernels*> kernels = supported_pixel_kernels();
+  bool ok = true;
+
+  std::printf("%zu pixels, %d runs, dispatching to %s\n\n", pixels, runs, pixel_kernels().name);
+  std::printf("%-20s %-8s %10s %8s\n", "kernel", "isa", "GB/s", "speedup");
+
+  for (const Case& c : cases)
+    {
+      const size_t bytes = c.body(scalar_pixel_kernels());
+      const double reference = seconds_per_run(c.body, scalar_pixel_kernels(), runs);
+
+      for (const PixelKernels* k : kernels)
+        {
+          const bool match = matches_scalar(c.body, *k, b);
+          const double t = seconds_per_run(c.body, *k, runs);
+
+          std::printf("%-20s %-8s %10.2f %7.2fx%s\n", c.name, k->name, bytes / t * 1e-9, reference / t,
+                      match ? "" : "  MISMATCH");
+
+          ok = ok && match;
+        }
+    }
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,130 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "resend_policy.hpp"
+
+#include <algorithm>
+
+// Most requests per packet the latency bound is split over.
+static const int MAX_RETRIES = 3;
+
+// Loss free samples before resend is turned off again.
+static const int QUIET_SAMPLES = 30;
+
+// Samples with resend on before judging whether it helps.
+static const int EVALUATE_SAMPLES = 10;
+
+// How long to stay off after resend was found not to help.
+static const std::chrono::seconds BACKOFF ( 60 );
+
+i3ds::ResendPolicy::ResendPolicy(int latency_bound)
+  : latency_bound_(std::max(latency_bound, 0)),
+    max_retries_(MAX_RETRIES),
+    has_last_(false),
+    samples_(0),
+    quiet_(0),
+    loss_without_(0.0),
+    frames_with_(0),
+    lost_with_(0)
+{
+  // Give a late packet a tenth of the bound before asking for it, and
+  // split the rest so that all retries fit.
+  settings_.enabled = false;
+  settings_.delay = latency_bound_ / 10;
+  settings_.timeout = std::max((latency_bound_ - settings_.delay) / max_retries_, 1);
+  settings_.retries = 1;
+}
+
+bool
+i3ds::ResendPolicy::update(std::chrono::steady_clock::time_point now, const LossCounters& counters)
+{
+  if (!has_last_)
+    {
+      has_last_ = true;
+      last_ = counters;
+      return false;
+    }
+
+  const int64_t frames = counters.frames() - last_.frames();
+  const int64_t lost = counters.lost() - last_.lost();
+  const int64_t missing = counters.missing_packets - last_.missing_packets;
+  const int64_t recovered = counters.recovered_packets - last_.recovered_packets;
+
+  last_ = counters;
+
+  if (latency_bound_ == 0 || frames == 0)
+    {
+      return false;
+    }
+
+  const ResendSettings before = settings_;
+
+  samples_++;
+  quiet_ = (missing == 0 && recovered == 0) ? quiet_ + 1 : 0;
+
+  if (!settings_.enabled)
+    {
+      // Running average of the loss ratio without resend.
+      loss_without_ += ((double) lost / frames - loss_without_) / std::min(samples_, EVALUATE_SAMPLES);
+
+      if (missing > 0 && now >= retry_after_)
+        {
+          enable();
+        }
+    }
+  else
+    {
+      frames_with_ += frames;
+      lost_with_ += lost;
+
+      const int affordable = (latency_bound_ - settings_.delay) / settings_.timeout;
+
+      if (quiet_ >= QUIET_SAMPLES)
+        {
+          // Clean link, stop paying for resend bookkeeping.
+          disable();
+        }
+      else if (samples_ >= EVALUATE_SAMPLES && lost_with_ > 0
+               && (double) lost_with_ / frames_with_ >= loss_without_)
+        {
+          // Resend delivers no more frames than going without.
+          disable();
+          retry_after_ = now + BACKOFF;
+        }
+      else if (missing > 0 && settings_.retries < std::min(max_retries_, affordable))
+        {
+          settings_.retries++;
+        }
+    }
+
+  return settings_ != before;
+}
+
+void
+i3ds::ResendPolicy::enable()
+{
+  settings_.enabled = true;
+  settings_.retries = 1;
+
+  samples_ = 0;
+  quiet_ = 0;
+  frames_with_ = 0;
+  lost_with_ = 0;
+}
+
+void
+i3ds::ResendPolicy::disable()
+{
+  settings_.enabled = false;
+
+  samples_ = 0;
+  quiet_ = 0;
+  loss_without_ = 0.0;
+}
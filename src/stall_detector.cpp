@@ -0,0 +1,65 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "stall_detector.hpp"
+
+#include <algorithm>
+
+i3ds::StallDetector::StallDetector()
+{
+  reset(0);
+}
+
+void
+i3ds::StallDetector::reset(int64_t period_us)
+{
+  interval_ = std::max<int64_t>(period_us, 0);
+  samples_ = period_us > 0 ? 1 : 0;
+  learned_ = false;
+  last_ = -1;
+  backoff_ = 1;
+}
+
+void
+i3ds::StallDetector::arrival(int64_t time_us)
+{
+  // The first arrival after a stall only starts the next interval, the
+  // backoff stays until frames are seen to arrive at a rate again.
+  if (last_ >= 0 && time_us > last_)
+    {
+      samples_ = std::min(samples_ + 1, (int) average_samples);
+      interval_ += (time_us - last_ - interval_) / samples_;
+      learned_ = true;
+      backoff_ = 1;
+    }
+
+  last_ = time_us;
+}
+
+void
+i3ds::StallDetector::stall()
+{
+  // The gap across a stall is not an interval between frames.
+  last_ = -1;
+
+  if (timeout() < max_timeout)
+    {
+      backoff_ *= 2;
+    }
+}
+
+int
+i3ds::StallDetector::timeout() const
+{
+  const double timeout = missed_periods * interval_ * backoff_ / 1000.0;
+
+  return (int) std::min<double>(std::max<double>(timeout, min_timeout), max_timeout);
+}
@@ -0,0 +1,126 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_clock_model
+
+#include <boost/test/unit_test.hpp>
+
+#include <cmath>
+
+#include "clock_model.hpp"
+
+using namespace i3ds;
+
+// Device ticks at the given host time, for a 125 MHz clock running fast
+// by drift ppm, offset by an arbitrary device epoch.
+static uint64_t
+ticks_at(int64_t host_us, double drift_ppm)
+{
+  return 1000000000ULL + (uint64_t) std::llround(host_us * (1.0 + drift_ppm * 1e-6) * 125.0);
+}
+
+BOOST_AUTO_TEST_CASE(unsynchronized_before_first_point)
+{
+  ClockModel clock;
+  int64_t host = 0;
+  double error = 0.0;
+
+  clock.reset(125e6);
+
+  BOOST_CHECK(!clock.toHost(12345, host, error));
+  BOOST_CHECK_EQUAL(clock.points(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(single_point_uses_nominal_rate)
+{
+  ClockModel clock;
+  int64_t host = 0;
+  double error = 0.0;
+
+  clock.reset(125e6);
+  clock.addPoint(ticks_at(0, 0.0), 5000000, 10.0);
+
+  BOOST_REQUIRE(clock.toHost(ticks_at(1000000, 0.0), host, error));
+  BOOST_CHECK_EQUAL(host, 6000000);
+  BOOST_CHECK_CLOSE(error, 10.0, 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE(fit_follows_drift)
+{
+  ClockModel clock;
+  int64_t host = 0;
+  double error = 0.0;
+
+  clock.reset(125e6);
+
+  // One point a second, with a jittering host latch time.
+  for (int i = 0; i < 20; i++)
+    {
+      const int64_t t = i * 1000000LL;
+      const int64_t jitter = (i % 3) - 1;
+
+      clock.addPoint(ticks_at(t, 50.0), t + jitter, 5.0);
+    }
+
+  BOOST_CHECK_CLOSE(clock.drift(), 50.0, 2.0);
+
+  // Extrapolating a second ahead stays within the error estimate.
+  BOOST_REQUIRE(clock.toHost(ticks_at(20000000, 50.0), host, error));
+  BOOST_CHECK_LE(std::abs(host - 20000000), error + 1.0);
+}
+
+BOOST_AUTO_TEST_CASE(window_forgets_old_points)
+{
+  ClockModel clock(4);
+
+  clock.reset(125e6);
+
+  for (int i = 0; i < 10; i++)
+    {
+      clock.addPoint(ticks_at(i * 1000000LL, 0.0), i * 1000000LL, 1.0);
+    }
+
+  BOOST_CHECK_EQUAL(clock.points(), 4u);
+}
+
+BOOST_AUTO_TEST_CASE(device_reset_starts_over)
+{
+  ClockModel clock;
+  int64_t host = 0;
+  double error = 0.0;
+
+  clock.reset(125e6);
+
+  clock.addPoint(ticks_at(0, 0.0), 0, 1.0);
+  clock.addPoint(ticks_at(1000000, 0.0), 1000000, 1.0);
+
+  // Device timestamp went back to zero at host time 2 s.
+  clock.addPoint(0, 2000000, 1.0);
+
+  BOOST_CHECK_EQUAL(clock.points(), 1u);
+
+  BOOST_REQUIRE(clock.toHost(125000000, host, error));
+  BOOST_CHECK_EQUAL(host, 3000000);
+}
+
+BOOST_AUTO_TEST_CASE(reset_forgets_points)
+{
+  ClockModel clock;
+  int64_t host = 0;
+  double error = 0.0;
+
+  clock.reset(125e6);
+  clock.addPoint(1000, 1000, 1.0);
+  clock.reset(125e6);
+
+  BOOST_CHECK(!clock.toHost(1000, host, error));
+}
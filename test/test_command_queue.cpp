@@ -0,0 +1,226 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_command_queue
+
+#include <boost/test/unit_test.hpp>
+
+#include <stdexcept>
+#include <vector>
+
+#include "command_queue.hpp"
+
+using namespace i3ds;
+
+BOOST_AUTO_TEST_CASE(commands_run_in_order)
+{
+  CommandQueue queue;
+  std::vector<int> order;
+
+  for (int i = 0; i < 10; i++)
+    {
+      queue.submit("", [&order, i]() {order.push_back(i);});
+    }
+
+  queue.flush();
+
+  BOOST_REQUIRE_EQUAL(order.size(), 10u);
+
+  for (int i = 0; i < 10; i++)
+    {
+      BOOST_CHECK_EQUAL(order[i], i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(same_key_coalesces)
+{
+  CommandQueue queue;
+  std::vector<int> written;
+
+  queue.pause();
+
+  std::shared_future<void> first = queue.submit("gain", [&written]() {written.push_back(1);});
+  queue.submit("shutter", [&written]() {written.push_back(10);});
+  std::shared_future<void> second = queue.submit("gain", [&written]() {written.push_back(2);});
+
+  BOOST_CHECK_EQUAL(queue.statistics().pending, 2);
+
+  queue.resume();
+  queue.flush();
+
+  // Only the last gain is written, after the shutter it was queued after.
+  BOOST_REQUIRE_EQUAL(written.size(), 2u);
+  BOOST_CHECK_EQUAL(written[0], 10);
+  BOOST_CHECK_EQUAL(written[1], 2);
+
+  BOOST_CHECK(first.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+  BOOST_CHECK(second.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+
+  const CommandQueue::Statistics stats = queue.statistics();
+
+  BOOST_CHECK_EQUAL(stats.executed, 2);
+  BOOST_CHECK_EQUAL(stats.coalesced, 1);
+  BOOST_CHECK_EQUAL(stats.pending, 0);
+}
+
+BOOST_AUTO_TEST_CASE(unkeyed_commands_never_coalesce)
+{
+  CommandQueue queue;
+  int count = 0;
+
+  queue.pause();
+
+  for (int i = 0; i < 5; i++)
+    {
+      queue.submit("", [&count]() {count++;});
+    }
+
+  queue.resume();
+  queue.flush();
+
+  BOOST_CHECK_EQUAL(count, 5);
+  BOOST_CHECK_EQUAL(queue.statistics().coalesced, 0);
+}
+
+BOOST_AUTO_TEST_CASE(exception_reaches_caller)
+{
+  CommandQueue queue;
+
+  std::shared_future<void> result = queue.submit("gain", []() {throw std::runtime_error("out of range");});
+
+  BOOST_CHECK_THROW(result.get(), std::runtime_error);
+
+  // The queue keeps running after a failed command.
+  bool ran = false;
+  queue.submit("gain", [&ran]() {ran = true;}).get();
+
+  // Counted after the result is set.
+  queue.flush();
+
+  BOOST_CHECK(ran);
+  BOOST_CHECK_EQUAL(queue.statistics().failed, 1);
+  BOOST_CHECK_EQUAL(queue.statistics().executed, 2);
+}
+
+BOOST_AUTO_TEST_CASE(paused_queue_holds_commands)
+{
+  CommandQueue queue;
+  bool ran = false;
+
+  queue.pause();
+
+  std::shared_future<void> result = queue.submit("gain", [&ran]() {ran = true;});
+
+  // Flush does not wait for held commands.
+  queue.flush();
+
+  BOOST_CHECK(result.wait_for(std::chrono::milliseconds(50)) == std::future_status::timeout);
+  BOOST_CHECK(!ran);
+
+  queue.resume();
+  result.get();
+
+  BOOST_CHECK(ran);
+}
+
+BOOST_AUTO_TEST_CASE(pause_waits_for_running_command)
+{
+  CommandQueue queue;
+  std::promise<void> started;
+  bool finished = false;
+
+  queue.submit("", [&started, &finished]()
+  {
+    started.set_value();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    finished = true;
+  });
+
+  started.get_future().wait();
+  queue.pause();
+
+  BOOST_CHECK(finished);
+
+  queue.resume();
+}
+
+BOOST_AUTO_TEST_CASE(stop_runs_remaining_commands)
+{
+  CommandQueue queue;
+  int count = 0;
+
+  queue.pause();
+
+  queue.submit("a", [&count]() {count++;});
+  queue.submit("b", [&count]() {count++;});
+
+  queue.stop();
+
+  BOOST_CHECK_EQUAL(count, 2);
+
+  // Stopped, commands run on the caller.
+  queue.submit("c", [&count]() {count++;}).get();
+
+  BOOST_CHECK_EQUAL(count, 3);
+}
+
+BOOST_AUTO_TEST_CASE(cancel_removes_pending_command)
+{
+  CommandQueue queue;
+  std::vector<int> written;
+
+  queue.pause();
+
+  std::shared_future<void> gain = queue.submit("gain", [&written]() {written.push_back(1);});
+  queue.submit("shutter", [&written]() {written.push_back(10);});
+
+  BOOST_CHECK(queue.cancel("gain"));
+  BOOST_CHECK(!queue.cancel("gain"));
+  BOOST_CHECK(!queue.cancel(""));
+
+  BOOST_REQUIRE(gain.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+  BOOST_CHECK_THROW(gain.get(), std::runtime_error);
+
+  queue.resume();
+  queue.flush();
+
+  BOOST_REQUIRE_EQUAL(written.size(), 1u);
+  BOOST_CHECK_EQUAL(written[0], 10);
+
+  const CommandQueue::Statistics stats = queue.statistics();
+
+  BOOST_CHECK_EQUAL(stats.executed, 1);
+  BOOST_CHECK_EQUAL(stats.cancelled, 1);
+}
+
+BOOST_AUTO_TEST_CASE(cancel_leaves_running_command)
+{
+  CommandQueue queue;
+  std::promise<void> started;
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+
+  std::shared_future<void> gain = queue.submit("gain", [&started, released]()
+  {
+    started.set_value();
+    released.wait();
+  });
+
+  started.get_future().wait();
+
+  BOOST_CHECK(!queue.cancel("gain"));
+
+  release.set_value();
+  gain.get();
+
+  BOOST_CHECK_EQUAL(queue.statistics().cancelled, 0);
+}
@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_delay_tuner
+
+#include <boost/test/unit_test.hpp>
+
+#include "delay_tuner.hpp"
+
+using namespace i3ds;
+
+// A link that loses packets below a threshold delay.
+class Link
+{
+public:
+
+  Link(DelayTuner& tuner, int64_t threshold) : tuner_(tuner), threshold_(threshold) {}
+
+  bool sample()
+  {
+    counters_.good += 10;
+
+    if (tuner_.delay() < threshold_)
+      {
+        counters_.missing_packets += 3;
+      }
+
+    return tuner_.update(counters_);
+  }
+
+  // Samples until the tuner settles, returns false if it never does.
+  bool settle()
+  {
+    for (int i = 0; i < 1000; i++)
+      {
+        sample();
+
+        if (tuner_.settled())
+          {
+            return true;
+          }
+      }
+
+    return false;
+  }
+
+  void threshold(int64_t threshold) {threshold_ = threshold;}
+
+private:
+
+  DelayTuner& tuner_;
+  int64_t threshold_;
+  LossCounters counters_;
+};
+
+BOOST_AUTO_TEST_CASE(reset_clamps_initial_delay)
+{
+  DelayTuner tuner;
+
+  tuner.reset(500, 1, 100);
+  BOOST_CHECK_EQUAL(tuner.delay(), 100);
+
+  tuner.reset(-5, 1, 100);
+  BOOST_CHECK_EQUAL(tuner.delay(), 0);
+  BOOST_CHECK(!tuner.settled());
+}
+
+BOOST_AUTO_TEST_CASE(loss_doubles_delay)
+{
+  DelayTuner tuner;
+  Link link(tuner, 1000);
+
+  tuner.reset(10, 1, 1000);
+
+  // The first sample only sets the baseline.
+  BOOST_CHECK(!link.sample());
+
+  BOOST_CHECK(link.sample());
+  BOOST_CHECK_EQUAL(tuner.delay(), 20);
+
+  BOOST_CHECK(link.sample());
+  BOOST_CHECK_EQUAL(tuner.delay(), 40);
+}
+
+BOOST_AUTO_TEST_CASE(search_finds_smallest_clean_delay)
+{
+  DelayTuner tuner;
+  Link link(tuner, 37);
+
+  tuner.reset(5, 1, 1000);
+
+  BOOST_REQUIRE(link.settle());
+  BOOST_CHECK_EQUAL(tuner.delay(), 37);
+}
+
+BOOST_AUTO_TEST_CASE(search_stops_within_step)
+{
+  DelayTuner tuner;
+  Link link(tuner, 37);
+
+  tuner.reset(5, 8, 1000);
+
+  BOOST_REQUIRE(link.settle());
+  BOOST_CHECK_GE(tuner.delay(), 37);
+  BOOST_CHECK_LE(tuner.delay(), 37 + 8);
+}
+
+BOOST_AUTO_TEST_CASE(clean_link_settles_at_zero)
+{
+  DelayTuner tuner;
+  Link link(tuner, 0);
+
+  tuner.reset(0, 1, 1000);
+
+  BOOST_REQUIRE(link.settle());
+  BOOST_CHECK_EQUAL(tuner.delay(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(lossy_at_max_settles_at_max)
+{
+  DelayTuner tuner;
+  Link link(tuner, 5000);
+
+  tuner.reset(10, 1, 100);
+
+  BOOST_REQUIRE(link.settle());
+  BOOST_CHECK_EQUAL(tuner.delay(), 100);
+}
+
+BOOST_AUTO_TEST_CASE(loss_after_settling_searches_again)
+{
+  DelayTuner tuner;
+  Link link(tuner, 20);
+
+  tuner.reset(5, 1, 1000);
+
+  BOOST_REQUIRE(link.settle());
+  BOOST_CHECK_EQUAL(tuner.delay(), 20);
+
+  link.threshold(60);
+
+  BOOST_CHECK(link.sample());
+  BOOST_CHECK(!tuner.settled());
+
+  BOOST_REQUIRE(link.settle());
+  BOOST_CHECK_EQUAL(tuner.delay(), 60);
+}
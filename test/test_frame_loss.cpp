@@ -0,0 +1,136 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_frame_loss
+
+#include <boost/test/unit_test.hpp>
+
+#include "frame_loss.hpp"
+
+using namespace i3ds;
+
+BOOST_AUTO_TEST_CASE(consecutive_blocks_lose_nothing)
+{
+  FrameLossTracker tracker;
+
+  for (uint64_t id = 1; id <= 10; id++)
+    {
+      tracker.frame(id, FrameOutcome::good, 0, 0);
+    }
+
+  const LossCounters c = tracker.counters();
+
+  BOOST_CHECK_EQUAL(c.good, 10);
+  BOOST_CHECK_EQUAL(c.lost(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(gap_counts_dropped_frames)
+{
+  FrameLossTracker tracker;
+
+  tracker.frame(100, FrameOutcome::good, 0, 0);
+  tracker.frame(104, FrameOutcome::good, 0, 0);
+
+  BOOST_CHECK_EQUAL(tracker.counters().dropped, 3);
+  BOOST_CHECK_EQUAL(tracker.counters().frames(), 5);
+}
+
+BOOST_AUTO_TEST_CASE(wrap_skips_zero)
+{
+  FrameLossTracker tracker;
+
+  tracker.frame(0xFFFF, FrameOutcome::good, 0, 0);
+  tracker.frame(1, FrameOutcome::good, 0, 0);
+
+  BOOST_CHECK_EQUAL(tracker.counters().dropped, 0);
+
+  FrameLossTracker lossy;
+
+  lossy.frame(0xFFFE, FrameOutcome::good, 0, 0);
+  lossy.frame(2, FrameOutcome::good, 0, 0);
+
+  // 0xFFFF and 1 are missing, zero is never used.
+  BOOST_CHECK_EQUAL(lossy.counters().dropped, 2);
+}
+
+BOOST_AUTO_TEST_CASE(restarted_device_is_not_loss)
+{
+  FrameLossTracker tracker;
+
+  // Block IDs starting over well before the wrap point.
+  tracker.frame(5000, FrameOutcome::good, 0, 0);
+  tracker.frame(1, FrameOutcome::good, 0, 0);
+
+  // A jump too large to be lost frames.
+  tracker.frame(1 + (1 << 21), FrameOutcome::good, 0, 0);
+
+  BOOST_CHECK_EQUAL(tracker.counters().dropped, 0);
+}
+
+BOOST_AUTO_TEST_CASE(reset_forgets_last_block)
+{
+  FrameLossTracker tracker;
+
+  tracker.frame(10, FrameOutcome::good, 0, 0);
+  tracker.reset();
+  tracker.frame(20, FrameOutcome::good, 0, 0);
+
+  BOOST_CHECK_EQUAL(tracker.counters().dropped, 0);
+}
+
+BOOST_AUTO_TEST_CASE(outcomes_and_packets)
+{
+  FrameLossTracker tracker;
+
+  tracker.frame(1, FrameOutcome::good, 0, 2);
+  tracker.frame(2, FrameOutcome::incomplete, 3, 1);
+  tracker.frame(3, FrameOutcome::timed_out, 0, 0);
+
+  const LossCounters c = tracker.counters();
+
+  BOOST_CHECK_EQUAL(c.good, 1);
+  BOOST_CHECK_EQUAL(c.incomplete, 1);
+  BOOST_CHECK_EQUAL(c.timed_out, 1);
+  BOOST_CHECK_EQUAL(c.lost(), 2);
+  BOOST_CHECK_EQUAL(c.missing_packets, 3);
+  BOOST_CHECK_EQUAL(c.recovered_packets, 3);
+}
+
+BOOST_AUTO_TEST_CASE(window_rates)
+{
+  using std::chrono::seconds;
+
+  const std::chrono::steady_clock::time_point t0;
+  LossWindow window(seconds(10));
+  LossCounters c;
+
+  BOOST_CHECK_EQUAL(window.frameLossRate(), 0.0);
+
+  window.add(t0, c);
+
+  c.good = 90;
+  c.dropped = 10;
+  c.missing_packets = 50;
+  window.add(t0 + seconds(5), c);
+
+  BOOST_CHECK_CLOSE(window.frameLossRate(), 0.1, 1e-9);
+  BOOST_CHECK_CLOSE(window.missingPacketRate(), 10.0, 1e-9);
+
+  // The first sample falls out of the window, so only the last
+  // interval counts.
+  c.good = 190;
+  window.add(t0 + seconds(15), c);
+  window.add(t0 + seconds(16), c);
+
+  BOOST_CHECK_EQUAL(window.frameLossRate(), 0.0);
+  BOOST_CHECK_EQUAL(window.missingPacketRate(), 0.0);
+}
@@ -0,0 +1,168 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_frame_ring
+
+#include <boost/test/unit_test.hpp>
+
+#include <thread>
+
+#include "frame_ring.hpp"
+
+using namespace i3ds;
+
+BOOST_AUTO_TEST_CASE(capacity_is_rounded_up)
+{
+  BOOST_CHECK_EQUAL(FrameRing<int>(1).Capacity(), 1);
+  BOOST_CHECK_EQUAL(FrameRing<int>(5).Capacity(), 8);
+  BOOST_CHECK_EQUAL(FrameRing<int>(8).Capacity(), 8);
+}
+
+BOOST_AUTO_TEST_CASE(invalid_capacity_throws)
+{
+  BOOST_CHECK_THROW(FrameRing<int>(0), std::invalid_argument);
+  BOOST_CHECK_THROW(FrameRing<int>(FrameRing<int>::max_capacity + 1), std::invalid_argument);
+
+  // What a negative ring size becomes.
+  BOOST_CHECK_THROW(FrameRing<int>(static_cast<size_t>(-1)), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(push_until_full_and_pop_in_order)
+{
+  FrameRing<int> ring(4);
+
+  for (int i = 0; i < 4; i++)
+    {
+      BOOST_CHECK(ring.TryPush(i));
+    }
+
+  BOOST_CHECK(!ring.TryPush(4));
+  BOOST_CHECK_EQUAL(ring.Depth(), 4);
+
+  int item = -1;
+
+  for (int i = 0; i < 4; i++)
+    {
+      BOOST_CHECK(ring.TryPop(item));
+      BOOST_CHECK_EQUAL(item, i);
+    }
+
+  BOOST_CHECK(!ring.TryPop(item));
+  BOOST_CHECK_EQUAL(ring.Depth(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(wraps_around)
+{
+  FrameRing<int> ring(2);
+  int item = -1;
+
+  for (int i = 0; i < 100; i++)
+    {
+      BOOST_CHECK(ring.TryPush(i));
+      BOOST_CHECK(ring.TryPop(item));
+      BOOST_CHECK_EQUAL(item, i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(producer_drops_oldest)
+{
+  FrameRing<int> ring(2);
+  int item = -1;
+
+  ring.TryPush(1);
+  ring.TryPush(2);
+
+  // What the drop-oldest policy does when full.
+  BOOST_CHECK(ring.TryPop(item));
+  BOOST_CHECK_EQUAL(item, 1);
+  BOOST_CHECK(ring.TryPush(3));
+
+  BOOST_CHECK(ring.TryPop(item));
+  BOOST_CHECK_EQUAL(item, 2);
+  BOOST_CHECK(ring.TryPop(item));
+  BOOST_CHECK_EQUAL(item, 3);
+}
+
+BOOST_AUTO_TEST_CASE(wait_times_out_when_empty)
+{
+  FrameRing<int> ring(2);
+  int item = -1;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  BOOST_CHECK(!ring.WaitPop(item, std::chrono::milliseconds(20)));
+  BOOST_CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+
+  ring.TryPush(1);
+  ring.TryPush(2);
+
+  BOOST_CHECK(!ring.WaitSpace(std::chrono::milliseconds(1)));
+}
+
+BOOST_AUTO_TEST_CASE(interrupt_wakes_waiting_consumer)
+{
+  FrameRing<int> ring(2);
+  int item = -1;
+
+  std::thread interrupter([&ring]()
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ring.Interrupt();
+  });
+
+  const auto start = std::chrono::steady_clock::now();
+
+  BOOST_CHECK(!ring.WaitPop(item, std::chrono::seconds(10)));
+  BOOST_CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+
+  interrupter.join();
+
+  // Further waits return at once until reset.
+  BOOST_CHECK(!ring.WaitPop(item, std::chrono::seconds(10)));
+
+  ring.Reset();
+  BOOST_CHECK(!ring.WaitPop(item, std::chrono::milliseconds(1)));
+}
+
+BOOST_AUTO_TEST_CASE(producer_and_consumer_threads)
+{
+  const int count = 100000;
+
+  FrameRing<int> ring(8);
+
+  std::thread producer([&ring]()
+  {
+    for (int i = 1; i <= count; i++)
+      {
+        while (!ring.TryPush(i))
+          {
+            ring.WaitSpace(std::chrono::milliseconds(10));
+          }
+      }
+  });
+
+  int expected = 1;
+  int item = 0;
+
+  while (expected <= count)
+    {
+      if (ring.WaitPop(item, std::chrono::milliseconds(10)))
+        {
+          BOOST_REQUIRE_EQUAL(item, expected);
+          expected++;
+        }
+    }
+
+  producer.join();
+
+  BOOST_CHECK_EQUAL(ring.Depth(), 0);
+}
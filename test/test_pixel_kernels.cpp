@@ -0,0 +1,165 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_pixel_kernels
+
+#include <boost/test/unit_test.hpp>
+
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "pixel_kernels.hpp"
+
+using namespace i3ds;
+
+// Lengths around the vector widths of every instruction set, so that both
+// the vector loops and the scalar tails are covered.
+static const size_t LENGTHS[] = {0, 1, 2, 3, 5, 7, 8, 9, 15, 16, 17, 23, 31, 32, 33, 47, 63, 64, 65, 127, 1001};
+
+// Output space past the end, which no kernel may write.
+static const size_t GUARD = 64;
+
+static std::vector<uint8_t>
+random_bytes(size_t n, unsigned seed)
+{
+  std::mt19937 random(seed);
+  std::vector<uint8_t> bytes(n);
+
+  for (auto& b : bytes)
+    {
+      b = (uint8_t) random();
+    }
+
+  return bytes;
+}
+
+static std::vector<uint16_t>
+random_pixels(size_t n, unsigned seed, uint16_t mask)
+{
+  std::mt19937 random(seed);
+  std::vector<uint16_t> pixels(n);
+
+  for (auto& p : pixels)
+    {
+      p = (uint16_t) (random() & mask);
+    }
+
+  return pixels;
+}
+
+// Runs the kernel of every supported set on the given lengths, and checks
+// the output against the scalar one, guard included.
+template<typename T>
+static void
+check_all(const char* kernel, std::function<void(const PixelKernels&, size_t, T*)> run)
+{
+  for (const PixelKernels* k : supported_pixel_kernels())
+    {
+      for (size_t n : LENGTHS)
+        {
+          std::vector<T> expected(n + GUARD, (T) 0xA5A5);
+          std::vector<T> actual(n + GUARD, (T) 0xA5A5);
+
+          run(scalar_pixel_kernels(), n, expected.data());
+          run(*k, n, actual.data());
+
+          BOOST_CHECK_MESSAGE(expected == actual, kernel << " " << k->name << " differs for " << n << " pixels");
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(scalar_unpack_reference)
+{
+  const uint8_t packed[] = {0xAB, 0xDC, 0xEF};
+  uint16_t out[2];
+
+  scalar_pixel_kernels().unpack_mono12packed(packed, out, 2);
+  BOOST_CHECK_EQUAL(out[0], 0xABC);
+  BOOST_CHECK_EQUAL(out[1], 0xEFD);
+
+  scalar_pixel_kernels().unpack_mono12p(packed, out, 2);
+  BOOST_CHECK_EQUAL(out[0], 0xCAB);
+  BOOST_CHECK_EQUAL(out[1], 0xEFD);
+}
+
+BOOST_AUTO_TEST_CASE(scalar_is_first)
+{
+  const std::vector<const PixelKernels*> kernels = supported_pixel_kernels();
+
+  BOOST_REQUIRE(!kernels.empty());
+  BOOST_CHECK(kernels.front() == &scalar_pixel_kernels());
+  BOOST_CHECK(&pixel_kernels() == kernels.back());
+}
+
+BOOST_AUTO_TEST_CASE(unpack_matches_scalar)
+{
+  check_all<uint16_t>("unpack_mono12packed", [](const PixelKernels& k, size_t n, uint16_t* dst)
+  {
+    // Exactly the packed size, so that reading past it is not hidden.
+    const std::vector<uint8_t> src = random_bytes(packed12_size(n), 1);
+    k.unpack_mono12packed(src.data(), dst, n);
+  });
+
+  check_all<uint16_t>("unpack_mono12p", [](const PixelKernels& k, size_t n, uint16_t* dst)
+  {
+    const std::vector<uint8_t> src = random_bytes(packed12_size(n), 2);
+    k.unpack_mono12p(src.data(), dst, n);
+  });
+}
+
+BOOST_AUTO_TEST_CASE(shift_matches_scalar)
+{
+  for (int shift = 0; shift <= 8; shift++)
+    {
+      check_all<uint8_t>("shift_to_8", [shift](const PixelKernels& k, size_t n, uint8_t* dst)
+      {
+        const std::vector<uint16_t> src = random_pixels(n, 3, 0xFFFF);
+        k.shift_to_8(src.data(), dst, n, shift);
+      });
+    }
+}
+
+BOOST_AUTO_TEST_CASE(window_matches_scalar)
+{
+  const uint16_t windows[][2] = {{0, 4095}, {300, 3000}, {1000, 1001}, {2000, 2000}, {3000, 300}, {0, 65535}};
+
+  for (const auto& w : windows)
+    {
+      const uint16_t low = w[0];
+      const uint16_t high = w[1];
+
+      check_all<uint8_t>("window_to_8", [low, high](const PixelKernels& k, size_t n, uint8_t* dst)
+      {
+        const std::vector<uint16_t> src = random_pixels(n, 4, 0xFFFF);
+        k.window_to_8(src.data(), dst, n, low, high);
+      });
+    }
+}
+
+BOOST_AUTO_TEST_CASE(align_matches_scalar)
+{
+  for (int depth : {8, 10, 12, 14, 16})
+    {
+      check_all<uint16_t>("align_msb", [depth](const PixelKernels& k, size_t n, uint16_t* dst)
+      {
+        const std::vector<uint16_t> src = random_pixels(n, 5, (uint16_t) ((1u << depth) - 1));
+        k.align_msb(src.data(), dst, n, depth);
+      });
+
+      check_all<uint16_t>("align_lsb", [depth](const PixelKernels& k, size_t n, uint16_t* dst)
+      {
+        const std::vector<uint16_t> src = random_pixels(n, 6, 0xFFFF);
+        k.align_lsb(src.data(), dst, n, depth);
+      });
+    }
+}
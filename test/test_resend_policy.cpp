@@ -0,0 +1,154 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_resend_policy
+
+#include <boost/test/unit_test.hpp>
+
+#include "resend_policy.hpp"
+
+using namespace i3ds;
+using std::chrono::seconds;
+
+// Feeds one statistics sample a second to the policy.
+class Link
+{
+public:
+
+  explicit Link(ResendPolicy& policy) : policy_(policy) {}
+
+  bool sample(int64_t good, int64_t incomplete, int64_t missing, int64_t recovered)
+  {
+    counters_.good += good;
+    counters_.incomplete += incomplete;
+    counters_.missing_packets += missing;
+    counters_.recovered_packets += recovered;
+
+    now_ += seconds(1);
+
+    return policy_.update(now_, counters_);
+  }
+
+  void wait(seconds time) {now_ += time;}
+
+private:
+
+  ResendPolicy& policy_;
+  LossCounters counters_;
+  std::chrono::steady_clock::time_point now_;
+};
+
+BOOST_AUTO_TEST_CASE(settings_fit_latency_bound)
+{
+  ResendPolicy policy(100);
+
+  BOOST_CHECK(!policy.settings().enabled);
+  BOOST_CHECK_EQUAL(policy.settings().delay, 10);
+  BOOST_CHECK_EQUAL(policy.settings().timeout, 30);
+  BOOST_CHECK_EQUAL(policy.settings().retries, 1);
+}
+
+BOOST_AUTO_TEST_CASE(zero_bound_never_resends)
+{
+  ResendPolicy policy(0);
+  Link link(policy);
+
+  for (int i = 0; i < 5; i++)
+    {
+      BOOST_CHECK(!link.sample(90, 10, 50, 0));
+    }
+
+  BOOST_CHECK(!policy.settings().enabled);
+}
+
+BOOST_AUTO_TEST_CASE(loss_enables_resend)
+{
+  ResendPolicy policy(100);
+  Link link(policy);
+
+  // The first sample only sets the baseline.
+  BOOST_CHECK(!link.sample(100, 0, 0, 0));
+  BOOST_CHECK(!link.sample(100, 0, 0, 0));
+
+  BOOST_CHECK(link.sample(99, 1, 5, 0));
+  BOOST_CHECK(policy.settings().enabled);
+}
+
+BOOST_AUTO_TEST_CASE(retries_grow_within_bound)
+{
+  ResendPolicy policy(100);
+  Link link(policy);
+
+  link.sample(0, 0, 0, 0);
+  link.sample(99, 1, 5, 0);
+
+  BOOST_REQUIRE(policy.settings().enabled);
+
+  // Recovered packets, but still some lost for good.
+  for (int i = 0; i < 5; i++)
+    {
+      link.sample(100, 0, 1, 10);
+    }
+
+  BOOST_CHECK_EQUAL(policy.settings().retries, 3);
+  BOOST_CHECK_LE(policy.settings().delay + policy.settings().retries * policy.settings().timeout, 100);
+}
+
+BOOST_AUTO_TEST_CASE(quiet_link_disables_resend)
+{
+  ResendPolicy policy(100);
+  Link link(policy);
+
+  link.sample(0, 0, 0, 0);
+  link.sample(99, 1, 5, 0);
+
+  BOOST_REQUIRE(policy.settings().enabled);
+
+  bool changed = false;
+
+  for (int i = 0; i < 30; i++)
+    {
+      changed = link.sample(100, 0, 0, 0);
+    }
+
+  BOOST_CHECK(changed);
+  BOOST_CHECK(!policy.settings().enabled);
+}
+
+BOOST_AUTO_TEST_CASE(useless_resend_backs_off)
+{
+  ResendPolicy policy(100);
+  Link link(policy);
+
+  link.sample(0, 0, 0, 0);
+
+  // Ten percent loss without resend.
+  link.sample(90, 10, 20, 0);
+
+  BOOST_REQUIRE(policy.settings().enabled);
+
+  // Twenty percent with it, as on a congested link.
+  for (int i = 0; i < 10; i++)
+    {
+      link.sample(80, 20, 20, 5);
+    }
+
+  BOOST_CHECK(!policy.settings().enabled);
+
+  // Not tried again until the backoff has passed.
+  link.sample(90, 10, 20, 0);
+  BOOST_CHECK(!policy.settings().enabled);
+
+  link.wait(seconds(60));
+  link.sample(90, 10, 20, 0);
+  BOOST_CHECK(policy.settings().enabled);
+}
@@ -0,0 +1,145 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2018 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE test_stall_detector
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdlib>
+
+#include "stall_detector.hpp"
+
+using namespace i3ds;
+
+BOOST_AUTO_TEST_CASE(timeout_from_configured_period)
+{
+  StallDetector detector;
+
+  detector.reset(100000);
+
+  BOOST_CHECK_EQUAL(detector.interval(), 100000);
+  BOOST_CHECK_EQUAL(detector.timeout(), 400);
+  BOOST_CHECK(!detector.learned());
+}
+
+BOOST_AUTO_TEST_CASE(timeout_is_bounded)
+{
+  StallDetector detector;
+
+  detector.reset(0);
+  BOOST_CHECK_EQUAL(detector.timeout(), 20);
+
+  detector.reset(60000000);
+  BOOST_CHECK_EQUAL(detector.timeout(), 10000);
+}
+
+BOOST_AUTO_TEST_CASE(interval_learned_from_arrivals)
+{
+  StallDetector detector;
+
+  // Configured for 10 Hz, but frames arrive at 20 Hz.
+  detector.reset(100000);
+
+  detector.arrival(0);
+  BOOST_CHECK(!detector.learned());
+
+  for (int i = 1; i <= 50; i++)
+    {
+      detector.arrival(i * 50000LL);
+    }
+
+  BOOST_CHECK(detector.learned());
+  BOOST_CHECK_LE(std::abs(detector.interval() - 50000), 100);
+}
+
+BOOST_AUTO_TEST_CASE(stall_backs_off)
+{
+  StallDetector detector;
+
+  detector.reset(100000);
+
+  detector.stall();
+  BOOST_CHECK_EQUAL(detector.timeout(), 800);
+
+  detector.stall();
+  BOOST_CHECK_EQUAL(detector.timeout(), 1600);
+
+  for (int i = 0; i < 10; i++)
+    {
+      detector.stall();
+    }
+
+  BOOST_CHECK_EQUAL(detector.timeout(), 10000);
+}
+
+BOOST_AUTO_TEST_CASE(backoff_kept_until_interval_measured)
+{
+  StallDetector detector;
+
+  detector.reset(100000);
+  detector.arrival(0);
+  detector.stall();
+  detector.stall();
+
+  // A single frame after a stall says nothing about the rate.
+  detector.arrival(5000000);
+  BOOST_CHECK_EQUAL(detector.timeout(), 1600);
+  BOOST_CHECK_EQUAL(detector.interval(), 100000);
+
+  detector.arrival(5100000);
+  BOOST_CHECK_EQUAL(detector.timeout(), 400);
+}
+
+BOOST_AUTO_TEST_CASE(slow_trigger_is_learned)
+{
+  StallDetector detector;
+
+  // Configured for 10 Hz, triggered every 2 s. The camera stalls until the
+  // timeout has backed off past the trigger interval, then learns it.
+  detector.reset(100000);
+
+  int64_t now = 0;
+
+  for (int frame = 0; frame < 20; frame++)
+    {
+      const int64_t next = (frame + 1) * 2000000LL;
+
+      while (now + detector.timeout() * 1000LL < next)
+        {
+          now += detector.timeout() * 1000LL;
+          detector.stall();
+        }
+
+      now = next;
+      detector.arrival(now);
+    }
+
+  BOOST_CHECK(detector.learned());
+  BOOST_CHECK_GT(detector.interval(), 1500000);
+  BOOST_CHECK_GT(detector.timeout(), 2000);
+}
+
+BOOST_AUTO_TEST_CASE(reset_forgets_interval)
+{
+  StallDetector detector;
+
+  detector.reset(100000);
+  detector.arrival(0);
+  detector.arrival(50000);
+  detector.stall();
+
+  detector.reset(200000);
+
+  BOOST_CHECK(!detector.learned());
+  BOOST_CHECK_EQUAL(detector.interval(), 200000);
+  BOOST_CHECK_EQUAL(detector.timeout(), 800);
+}